@@ -0,0 +1,443 @@
+// Asynchronous I/O.
+//
+// aiosetup() maps an area into the calling process whose first page
+// holds the submission and completion rings of aio.h and whose other
+// pages hold I/O buffers.  aioenter() moves submitted entries onto a
+// queue served by NAIOTHREAD kernel threads, so one process can have
+// up to AIO_NENT reads and writes in the buffer cache and disk queue
+// at once, and completions are posted to the ring without a system
+// call.  The workers reach the buffers through the kernel addresses
+// of the area's pages, which the context holds a reference to, so a
+// process that shrinks its memory cannot pull a page out from under
+// a request.  exec() and exit() cancel requests still queued and
+// leave those in flight to their workers, which may be blocked on a
+// pipe or the console indefinitely: the context is marked dead and
+// the worker finishing its last request drops the completion and
+// frees it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "aio.h"
+
+#define AIOPATH 128  // longest AIO_OPEN path
+
+struct aioreq {
+  struct aioctx *ctx;      // 0 if this slot is free
+  struct aiosqe sqe;       // copied at submission
+  struct file *f;
+  struct inode *cwd;       // AIO_OPEN: submitter's current directory
+  struct aioreq *next;     // in aio.head
+};
+
+struct aioctx {
+  int used;
+  int npages;
+  char *pages[NAIOPG];     // pages[0] holds the rings
+  int inflight;            // requests taken but not completed
+  int dead;                // owner gone; last worker frees
+  int ndead;               // failed opens whose fds must be closed
+  int deadfd[AIO_NENT];
+  struct file *deadf[AIO_NENT];
+};
+
+#define RINGS(c) ((struct aiorings*)(c)->pages[0])
+
+struct {
+  struct spinlock lock;
+  struct aioctx ctx[NAIOCTX];
+  struct aioreq req[NAIOREQ];
+  struct aioreq *head;     // requests waiting for a worker
+  struct aioreq *tail;
+} aio;
+
+static void aioworker(void*);
+
+void
+aioinit(void)
+{
+  int i;
+
+  initlock(&aio.lock, "aio");
+  for(i = 0; i < NAIOTHREAD; i++)
+    if(kthread_create("aio", aioworker, 0) == 0)
+      panic("aioinit");
+}
+
+static void
+aiofree(struct aioctx *c)
+{
+  int i;
+
+  for(i = 0; i < c->npages; i++)
+    kfree(c->pages[i]);
+  c->npages = 0;
+  acquire(&aio.lock);
+  c->used = 0;
+  release(&aio.lock);
+}
+
+// Map a new area of nbuf buffer pages after the rings
+// at the top of the current process's memory.
+// Returns its address, or -1 on error.
+int
+aiosetup(int nbuf)
+{
+  struct proc *curproc = myproc();
+  struct aioctx *c;
+  uint va;
+
+  if(curproc->aio || nbuf < 0 || nbuf >= NAIOPG)
+    return -1;
+  acquire(&aio.lock);
+  for(c = aio.ctx; c < &aio.ctx[NAIOCTX]; c++)
+    if(!c->used)
+      break;
+  if(c == &aio.ctx[NAIOCTX]){
+    release(&aio.lock);
+    return -1;
+  }
+  c->used = 1;
+  release(&aio.lock);
+
+  c->npages = 0;
+  c->inflight = 0;
+  c->dead = 0;
+  c->ndead = 0;
+  va = PGROUNDUP(curproc->sz);
+  if(va + (nbuf+1)*PGSIZE >= KERNBASE)
+    goto bad;
+  while(c->npages <= nbuf){
+    if((c->pages[c->npages] = kalloc_zeroed()) == 0)
+      goto bad;
+    c->npages++;
+    if(shareuvm(curproc->pgdir, va + (c->npages-1)*PGSIZE,
+                V2P(c->pages[c->npages-1]), PTE_W|PTE_U|PTE_SHARED) < 0)
+      goto bad;
+  }
+  curproc->sz = va + c->npages*PGSIZE;
+  curproc->aio = c;
+  switchuvm(curproc);
+  return va;
+
+bad:
+  deallocuvm(curproc->pgdir, va + c->npages*PGSIZE, va);
+  aiofree(c);
+  return -1;
+}
+
+// Number of completions the process has not consumed.
+// cqhead is the process's to write, so do not trust it.
+static uint
+cqready(struct aiorings *r)
+{
+  uint n;
+
+  n = r->cqtail - r->cqhead;
+  return n > AIO_NENT ? AIO_NENT : n;
+}
+
+// Caller must hold aio.lock.
+static void
+aiopost(struct aioctx *c, uint data, int res)
+{
+  struct aiorings *r = RINGS(c);
+  struct aiocqe *e;
+
+  e = &r->cq[r->cqtail % AIO_NENT];
+  e->data = data;
+  e->res = res;
+  __sync_synchronize();
+  r->cqtail++;
+  wakeup(c);
+}
+
+// Check q's entry and take the references its worker will need.
+// An AIO_OPEN reserves an fd now, holding a file that stays
+// unreadable until the worker fills it in.
+// Caller must hold aio.lock.
+static int
+aioprep(struct aioreq *q, struct aioctx *c, struct proc *p)
+{
+  struct aiosqe *e = &q->sqe;
+  uint end = c->npages*PGSIZE;
+  int fd;
+
+  q->f = 0;
+  q->cwd = 0;
+  switch(e->op){
+  case AIO_READ:
+  case AIO_WRITE:
+    if(e->n < 0 || e->buf < AIO_BUF || e->buf > end || e->n > end - e->buf)
+      return -1;
+    // fall through
+  case AIO_FSYNC:
+    if(e->fd < 0 || e->fd >= NOFILE || p->ofile[e->fd] == 0)
+      return -1;
+    q->f = filedup(p->ofile[e->fd]);
+    return 0;
+  case AIO_OPEN:
+    if(e->buf < AIO_BUF || e->buf >= end)
+      return -1;
+    for(fd = 0; fd < NOFILE; fd++)
+      if(p->ofile[fd] == 0)
+        break;
+    if(fd == NOFILE || (q->f = filealloc()) == 0)
+      return -1;
+    q->f->readable = 0;
+    q->f->writable = 0;
+    p->ofile[fd] = filedup(q->f);
+    e->fd = fd;
+    q->cwd = idup(p->cwd);
+    return 0;
+  }
+  return -1;
+}
+
+// Close the fds reserved by opens that failed.
+static void
+aioreap(struct proc *p, struct aioctx *c)
+{
+  struct file *f;
+  int fd;
+
+  acquire(&aio.lock);
+  while(c->ndead > 0){
+    c->ndead--;
+    fd = c->deadfd[c->ndead];
+    f = c->deadf[c->ndead];
+    release(&aio.lock);
+    // The worker's reference keeps f from being reused,
+    // so f is still in the table only if nobody closed it.
+    if(p->ofile[fd] == f){
+      p->ofile[fd] = 0;
+      fileclose(f);
+    }
+    fileclose(f);
+    acquire(&aio.lock);
+  }
+  release(&aio.lock);
+}
+
+// Submit the entries from sqhead to sqtail, as many as fit in
+// the completion ring, then wait until minwait completions are
+// ready or nothing is in flight.
+// Returns the number of entries taken, or -1 on error.
+int
+aioenter(int minwait)
+{
+  struct proc *curproc = myproc();
+  struct aioctx *c = curproc->aio;
+  struct aiorings *r;
+  struct aioreq *q;
+  int n;
+
+  if(c == 0)
+    return -1;
+  r = RINGS(c);
+  aioreap(curproc, c);
+
+  n = 0;
+  acquire(&aio.lock);
+  while(r->sqhead != r->sqtail && cqready(r) + c->inflight < AIO_NENT){
+    for(q = aio.req; q < &aio.req[NAIOREQ]; q++)
+      if(q->ctx == 0)
+        break;
+    if(q == &aio.req[NAIOREQ])
+      break;
+    q->sqe = r->sq[r->sqhead % AIO_NENT];
+    r->sqhead++;
+    n++;
+    if(aioprep(q, c, curproc) < 0){
+      aiopost(c, q->sqe.data, -1);
+      continue;
+    }
+    q->ctx = c;
+    q->next = 0;
+    if(aio.head)
+      aio.tail->next = q;
+    else
+      aio.head = q;
+    aio.tail = q;
+    c->inflight++;
+    wakeup(&aio.head);
+  }
+
+  if(minwait > AIO_NENT)
+    minwait = AIO_NENT;
+  while(cqready(r) < minwait && c->inflight > 0 && !curproc->killed)
+    sleep(c, &aio.lock);
+  release(&aio.lock);
+  return n;
+}
+
+// Cancel p's queued requests and drop its context without
+// waiting for those a worker has started, which may never
+// finish.  The context goes when its last worker is done.
+// The area stays mapped until the page table is freed.
+void
+aiorelease(struct proc *p)
+{
+  struct aioctx *c = p->aio;
+  struct aioreq *q, **pp, *cancel;
+  int last;
+
+  if(c == 0)
+    return;
+  p->aio = 0;
+  cancel = 0;
+  acquire(&aio.lock);
+  aio.tail = 0;
+  for(pp = &aio.head; (q = *pp) != 0; ){
+    if(q->ctx == c){
+      *pp = q->next;
+      q->next = cancel;
+      cancel = q;
+      c->inflight--;
+    } else {
+      aio.tail = q;
+      pp = &q->next;
+    }
+  }
+  release(&aio.lock);
+
+  while((q = cancel) != 0){
+    cancel = q->next;
+    if(q->sqe.op == AIO_OPEN && p->ofile[q->sqe.fd] == q->f){
+      p->ofile[q->sqe.fd] = 0;
+      fileclose(q->f);
+    }
+    fileclose(q->f);
+    if(q->cwd){
+      begin_op();
+      iput(q->cwd);
+      end_op();
+    }
+    acquire(&aio.lock);
+    q->ctx = 0;
+    release(&aio.lock);
+  }
+
+  // Workers record failed opens only until c is dead.
+  for(;;){
+    aioreap(p, c);
+    acquire(&aio.lock);
+    if(c->ndead == 0)
+      break;
+    release(&aio.lock);
+  }
+  c->dead = 1;
+  last = c->inflight == 0;
+  release(&aio.lock);
+  if(last)
+    aiofree(c);
+}
+
+//PAGEBREAK!
+// Carry out q.  Returns its result for the completion.
+static int
+aiodo(struct aioreq *q)
+{
+  struct aioctx *c = q->ctx;
+  struct aiosqe *e = &q->sqe;
+  char path[AIOPATH], *ka;
+  int i, m, r, done;
+  uint va;
+
+  switch(e->op){
+  case AIO_READ:
+  case AIO_WRITE:
+    // The buffer may cross pages that are not adjacent
+    // in kernel memory.
+    r = 0;
+    done = 0;
+    while(done < e->n){
+      va = e->buf + done;
+      m = PGSIZE - va%PGSIZE;
+      if(m > e->n - done)
+        m = e->n - done;
+      ka = c->pages[va/PGSIZE] + va%PGSIZE;
+      if(e->op == AIO_READ)
+        r = e->off < 0 ? fileread(q->f, ka, m) :
+                         filepread(q->f, ka, m, e->off + done);
+      else
+        r = e->off < 0 ? filewrite(q->f, ka, m) :
+                         filepwrite(q->f, ka, m, e->off + done);
+      if(r <= 0)
+        break;
+      done += r;
+      if(r < m)
+        break;
+    }
+    return done == 0 && r < 0 ? -1 : done;
+
+  case AIO_FSYNC:
+    log_flush();
+    return 0;
+
+  case AIO_OPEN:
+    for(i = 0; i < AIOPATH; i++){
+      va = e->buf + i;
+      if(va >= c->npages*PGSIZE)
+        return -1;
+      if((path[i] = c->pages[va/PGSIZE][va%PGSIZE]) == 0)
+        break;
+    }
+    if(i == AIOPATH)
+      return -1;
+    myproc()->cwd = q->cwd;
+    r = fileopen(q->f, path, e->n);
+    myproc()->cwd = 0;
+    return r < 0 ? -1 : e->fd;
+  }
+  return -1;
+}
+
+static void
+aioworker(void *arg)
+{
+  struct aioreq *q;
+  struct aioctx *c;
+  int res, dead, last;
+
+  for(;;){
+    acquire(&aio.lock);
+    while((q = aio.head) == 0)
+      sleep(&aio.head, &aio.lock);
+    aio.head = q->next;
+    release(&aio.lock);
+
+    res = aiodo(q);
+    if(q->cwd){
+      begin_op();
+      iput(q->cwd);
+      end_op();
+    }
+    // A failed open keeps its file reference for aioreap(),
+    // unless the owner is gone and will never reap it.
+    c = q->ctx;
+    acquire(&aio.lock);
+    dead = q->sqe.op == AIO_OPEN && res < 0 && !c->dead;
+    if(dead){
+      c->deadfd[c->ndead] = q->sqe.fd;
+      c->deadf[c->ndead++] = q->f;
+    }
+    if(!c->dead)
+      aiopost(c, q->sqe.data, res);
+    c->inflight--;
+    q->ctx = 0;
+    last = c->dead && c->inflight == 0;
+    release(&aio.lock);
+    if(!dead)
+      fileclose(q->f);
+    if(last)
+      aiofree(c);
+  }
+}
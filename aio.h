@@ -0,0 +1,41 @@
+// Asynchronous I/O rings, shared by a process and the kernel.
+//
+// aiosetup() maps an area whose first page holds struct aiorings
+// and whose remaining pages hold I/O buffers.  The process fills
+// submission entries at sqtail and calls aioenter(); kernel worker
+// threads carry the requests out and post completions at cqtail,
+// which the process consumes by advancing cqhead.
+
+#define AIO_NENT   32    // ring entries: most requests in flight
+#define AIO_BUF    4096  // offset of the buffers in the area
+
+// Operations
+#define AIO_READ   1
+#define AIO_WRITE  2
+#define AIO_FSYNC  3
+#define AIO_OPEN   4
+
+// Submission queue entry.
+struct aiosqe {
+  int op;
+  int fd;
+  int off;         // file offset, or -1 to use and advance the file's own
+  uint buf;        // offset in the area of the data (AIO_OPEN: the path)
+  int n;           // bytes to read or write (AIO_OPEN: open mode)
+  uint data;       // copied to the completion
+};
+
+// Completion queue entry.
+struct aiocqe {
+  uint data;
+  int res;         // bytes, fd for AIO_OPEN, or -1
+};
+
+struct aiorings {
+  volatile uint sqhead;  // next entry the kernel takes
+  volatile uint sqtail;  // next entry the process fills
+  volatile uint cqhead;  // next entry the process reads
+  volatile uint cqtail;  // next entry the kernel fills
+  struct aiosqe sq[AIO_NENT];
+  struct aiocqe cq[AIO_NENT];
+};
@@ -0,0 +1,142 @@
+// Async I/O benchmark.
+// Creates a file through the aio rings with AIO_OPEN, AIO_WRITE and
+// AIO_FSYNC, then does random one-block reads of it through the
+// rings at queue depths 1 to 32 and prints how many reads each run
+// completed per tick.  Queue depth 1 behaves like read().
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "aio.h"
+
+#define BSIZE   512
+#define NBLK    128              // file size in blocks
+#define NREAD   2000             // reads per run
+#define NBUFPG  (AIO_NENT*BSIZE/4096)
+
+struct aiorings *r;
+char *area;
+uint seed = 1;
+
+uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+void
+submit(int op, int fd, int off, uint buf, int n, uint data)
+{
+  struct aiosqe *e;
+
+  e = &r->sq[r->sqtail % AIO_NENT];
+  e->op = op;
+  e->fd = fd;
+  e->off = off;
+  e->buf = buf;
+  e->n = n;
+  e->data = data;
+  r->sqtail++;
+}
+
+// Wait for the next completion and return its result.
+int
+reap(uint *data)
+{
+  struct aiocqe *e;
+
+  while(r->cqhead == r->cqtail)
+    aioenter(1);
+  e = &r->cq[r->cqhead % AIO_NENT];
+  if(data)
+    *data = e->data;
+  r->cqhead++;
+  return e->res;
+}
+
+int
+makefile(void)
+{
+  int fd, i, n;
+
+  strcpy(area + AIO_BUF, "aiobench.tmp");
+  submit(AIO_OPEN, 0, 0, AIO_BUF, O_CREATE|O_RDWR, 0);
+  aioenter(0);
+  if((fd = reap(0)) < 0){
+    printf(1, "aiobench: open failed\n");
+    exit();
+  }
+  memset(area + AIO_BUF, 'a', BSIZE);
+  i = n = 0;
+  while(n <= NBLK){
+    for(; i <= NBLK && r->sqtail - r->sqhead < AIO_NENT; i++){
+      if(i < NBLK)
+        submit(AIO_WRITE, fd, -1, AIO_BUF, BSIZE, 0);
+      else
+        submit(AIO_FSYNC, fd, 0, 0, 0, 0);
+    }
+    aioenter(1);
+    for(; r->cqhead != r->cqtail; n++){
+      if(reap(0) < 0){
+        printf(1, "aiobench: write failed\n");
+        exit();
+      }
+    }
+  }
+  return fd;
+}
+
+void
+aiorun(int fd, int qd)
+{
+  int sub, done, nfree, free[AIO_NENT];
+  uint t, slot;
+
+  nfree = 0;
+  for(slot = 0; slot < qd; slot++)
+    free[nfree++] = slot;
+  sub = done = 0;
+  t = uptime();
+  while(done < NREAD){
+    while(nfree > 0 && sub < NREAD){
+      slot = free[--nfree];
+      submit(AIO_READ, fd, (rnd() % NBLK)*BSIZE,
+             AIO_BUF + slot*BSIZE, BSIZE, slot);
+      sub++;
+    }
+    aioenter(1);
+    while(r->cqhead != r->cqtail){
+      if(reap(&slot) != BSIZE){
+        printf(1, "aiobench: aio read failed\n");
+        exit();
+      }
+      free[nfree++] = slot;
+      done++;
+    }
+  }
+  t = uptime() - t;
+  printf(1, "qd %d: %d reads in %d ticks", qd, NREAD, t);
+  if(t > 0)
+    printf(1, ", %d per tick", NREAD / t);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, qd;
+
+  if((area = aiosetup(NBUFPG)) == (char*)-1){
+    printf(1, "aiobench: aiosetup failed\n");
+    exit();
+  }
+  r = (struct aiorings*)area;
+  fd = makefile();
+  for(qd = 1; qd <= AIO_NENT; qd *= 2)
+    aiorun(fd, qd);
+  close(fd);
+  unlink("aiobench.tmp");
+  exit();
+}
@@ -0,0 +1,485 @@
+// Microbenchmarks in the style of lmbench.
+//
+// Each test times a loop with the time-stamp counter and prints
+//   bench: <name> <iterations> <cycles per op> <ns per op>
+// where the nanoseconds come from calibrating the counter against
+// the 10 ms clock tick.  Bandwidth tests count one op per KB.
+// The last line is "bench: done".  make qemu-bench runs this
+// under QEMU and collects the lines in bench.out.
+// Usage: bench [test...]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "x86.h"
+#include "aio.h"
+
+#define TICKNS  10000000   // ns per clock tick
+#define FILEKB  64         // size of the file for the I/O tests
+#define NWSFILE 4          // files of FILEKB in the working set test
+
+char buf[4096];
+uint tsctick;              // TSC cycles per tick
+uint64 t0;
+
+void
+calibrate(void)
+{
+  uint t;
+  uint64 c;
+
+  t = uptime();
+  while(uptime() == t)
+    ;
+  c = rdtsc();
+  t = uptime();
+  while(uptime() < t + 10)
+    ;
+  tsctick = div64(rdtsc() - c, 10);
+  printf(1, "bench: tsc_per_tick 1 %d %d\n", tsctick, TICKNS);
+}
+
+void
+start(void)
+{
+  t0 = rdtsc();
+}
+
+void
+stop(char *name, int n)
+{
+  uint cyc;
+
+  cyc = div64(rdtsc() - t0, n);
+  printf(1, "bench: %s %d %d %d\n", name, n, cyc,
+         (uint)div64((uint64)cyc * TICKNS, tsctick));
+}
+
+void
+die(char *s)
+{
+  printf(2, "bench: %s failed\n", s);
+  exit();
+}
+
+void
+null(void)
+{
+  int i, n = 10000;
+
+  start();
+  for(i = 0; i < n; i++)
+    close(-1);  // trap, fail the argument check, return
+  stop("null_syscall", n);
+
+  start();
+  for(i = 0; i < n; i++)
+    getpid();
+  stop("getpid", n);
+}
+
+void
+forkexit(void)
+{
+  int i, n = 200;
+
+  start();
+  for(i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0)
+      die("fork");
+    if(pid == 0)
+      exit();
+    wait();
+  }
+  stop("fork_exit", n);
+}
+
+void
+forkexec(void)
+{
+  char *argv[] = { "bench", "exit", 0 };
+  int i, n = 100;
+
+  start();
+  for(i = 0; i < n; i++){
+    int pid = fork();
+    if(pid < 0)
+      die("fork");
+    if(pid == 0){
+      exec("bench", argv);
+      die("exec");
+    }
+    wait();
+  }
+  stop("fork_exec", n);
+}
+
+void
+spawnwait(void)
+{
+  char *argv[] = { "bench", "exit", 0 };
+  int i, n = 100;
+
+  start();
+  for(i = 0; i < n; i++){
+    if(spawn("bench", argv, 0, 0) < 0)
+      die("spawn");
+    wait();
+  }
+  stop("spawn", n);
+}
+
+// Pipe round trips between two processes.  The context switch
+// cost is half a round trip less the pipe work, which is timed
+// in one process.
+void
+pipelat(void)
+{
+  int p1[2], p2[2], i, n = 2000;
+  uint64 t;
+  uint rtt, self, cs;
+
+  if(pipe(p1) < 0 || pipe(p2) < 0)
+    die("pipe");
+  start();
+  for(i = 0; i < n; i++){
+    write(p1[1], buf, 1);
+    read(p1[0], buf, 1);
+  }
+  t = rdtsc() - t0;
+  self = div64(t, n);
+
+  if(fork() == 0){
+    for(i = 0; i < n; i++){
+      read(p1[0], buf, 1);
+      write(p2[1], buf, 1);
+    }
+    exit();
+  }
+  start();
+  for(i = 0; i < n; i++){
+    write(p1[1], buf, 1);
+    read(p2[0], buf, 1);
+  }
+  t = rdtsc() - t0;
+  stop("pipe_latency", n);
+  wait();
+  rtt = div64(t, n);
+  cs = rtt > 2*self ? (rtt - 2*self) / 2 : 0;
+  printf(1, "bench: ctxsw %d %d %d\n", n, cs,
+         (uint)div64((uint64)cs * TICKNS, tsctick));
+  close(p1[0]);
+  close(p1[1]);
+  close(p2[0]);
+  close(p2[1]);
+}
+
+void
+pipebw(void)
+{
+  int p[2], i, n, kb = 2048;
+
+  if(pipe(p) < 0)
+    die("pipe");
+  if(fork() == 0){
+    close(p[0]);
+    for(i = 0; i < kb/4; i++)
+      write(p[1], buf, 4096);
+    exit();
+  }
+  close(p[1]);
+  start();
+  for(i = 0; i < kb*1024; i += n)
+    if((n = read(p[0], buf, sizeof(buf))) <= 0)
+      die("pipe read");
+  stop("pipe_bw_kb", kb);
+  close(p[0]);
+  wait();
+}
+
+void
+createdelete(void)
+{
+  int i, fd, n = 100;
+
+  start();
+  for(i = 0; i < n; i++){
+    if((fd = open("bench.f", O_CREATE|O_RDWR)) < 0)
+      die("create");
+    close(fd);
+    if(unlink("bench.f") < 0)
+      die("unlink");
+  }
+  stop("create_delete", n);
+}
+
+void
+seqio(void)
+{
+  int i, j, fd, reps = 4;
+
+  start();
+  for(j = 0; j < reps; j++){
+    if((fd = open("bench.f", O_CREATE|O_RDWR)) < 0)
+      die("create");
+    for(i = 0; i < FILEKB; i++)
+      if(write(fd, buf, 1024) != 1024)
+        die("write");
+    close(fd);
+  }
+  stop("seq_write_kb", reps*FILEKB);
+
+  start();
+  for(j = 0; j < reps; j++){
+    if((fd = open("bench.f", O_RDONLY)) < 0)
+      die("open");
+    for(i = 0; i < FILEKB; i++)
+      if(read(fd, buf, 1024) != 1024)
+        die("read");
+    close(fd);
+  }
+  stop("seq_read_kb", reps*FILEKB);
+}
+
+// xv6 has no lseek, so random I/O goes through the async I/O
+// rings one request at a time, with an explicit offset.
+// Uses the file that seqio() wrote.
+void
+randio(void)
+{
+  struct aiorings *r;
+  struct aiosqe *e;
+  uint seed = 1;
+  int i, fd, op, n = 500;
+
+  if((r = aiosetup(1)) == (struct aiorings*)-1)
+    die("aiosetup");
+  if((fd = open("bench.f", O_RDWR)) < 0)
+    die("open");
+  for(op = AIO_READ; op <= AIO_WRITE; op++){
+    start();
+    for(i = 0; i < n; i++){
+      seed = seed * 1103515245 + 12345;
+      e = &r->sq[r->sqtail % AIO_NENT];
+      e->op = op;
+      e->fd = fd;
+      e->off = ((seed >> 8) % (FILEKB*2)) * 512;
+      e->buf = AIO_BUF;
+      e->n = 512;
+      r->sqtail++;
+      aioenter(1);
+      if(r->cq[r->cqhead++ % AIO_NENT].res != 512)
+        die("random I/O");
+    }
+    stop(op == AIO_READ ? "rand_read_512" : "rand_write_512", n);
+  }
+  close(fd);
+  unlink("bench.f");
+}
+
+char wsname[] = "bench.w0";
+
+// Create, or with create 0 remove, the working set files.
+void
+wsfiles(int create)
+{
+  int i, j, fd;
+
+  for(j = 0; j < NWSFILE; j++){
+    wsname[7] = '0' + j;
+    if(!create){
+      unlink(wsname);
+      continue;
+    }
+    if((fd = open(wsname, O_CREATE|O_RDWR)) < 0)
+      die("create");
+    for(i = 0; i < FILEKB; i++)
+      if(write(fd, buf, 1024) != 1024)
+        die("write");
+    close(fd);
+  }
+}
+
+// Read a working set of NWSFILE files, much bigger than the
+// buffers the cache always has, after reading it once to warm
+// the cache.  /proc/bcache shows the hits.
+void
+wsread(void)
+{
+  int i, j, k, fd, reps = 4;
+
+  wsfiles(1);
+  for(k = 0; k <= reps; k++){
+    if(k == 1)
+      start();
+    for(j = 0; j < NWSFILE; j++){
+      wsname[7] = '0' + j;
+      if((fd = open(wsname, O_RDONLY)) < 0)
+        die("open");
+      for(i = 0; i < FILEKB; i++)
+        if(read(fd, buf, 1024) != 1024)
+          die("read");
+      close(fd);
+    }
+  }
+  stop("ws_read_kb", reps*NWSFILE*FILEKB);
+  wsfiles(0);
+}
+
+// Read the first working set file with pread() from one process,
+// then from four at once; with the inode locked shared, four
+// readers on four CPUs take about as long as one.
+void
+parread(void)
+{
+  int i, j, k, fd, np, n = 200;
+
+  wsfiles(1);
+  wsname[7] = '0';
+  for(np = 1; np <= 4; np *= 4){
+    start();
+    for(k = 0; k < np; k++){
+      if((i = fork()) < 0)
+        die("fork");
+      if(i == 0){
+        if((fd = open(wsname, O_RDONLY)) < 0)
+          die("open");
+        for(j = 0; j < n; j++)
+          if(pread(fd, buf, 1024, (j % FILEKB) * 1024) != 1024)
+            die("pread");
+        exit();
+      }
+    }
+    for(k = 0; k < np; k++)
+      wait();
+    stop(np == 1 ? "pread_1proc" : "pread_4proc", n);
+  }
+  wsfiles(0);
+}
+
+// Read the hits and misses from /proc/bcache.
+void
+bcstat(uint *hit, uint *miss)
+{
+  char b[128], *p;
+  uint v[5];
+  int fd, i, n;
+
+  memset(v, 0, sizeof(v));
+  if((fd = open("/proc/bcache", O_RDONLY)) >= 0){
+    n = read(fd, b, sizeof(b) - 1);
+    close(fd);
+    b[n > 0 ? n : 0] = 0;
+    // bufs, hot, hits, misses, evicts, after the header
+    p = strchr(b, '\n');
+    for(i = 0; p && i < 5; i++){
+      while(*p && (*p < '0' || *p > '9'))
+        p++;
+      v[i] = atoi(p);
+      while(*p >= '0' && *p <= '9')
+        p++;
+    }
+  }
+  *hit = v[2];
+  *miss = v[3];
+}
+
+// Open files, which reads directory and inode blocks, between
+// streaming reads of the working set, and report the hit rate of
+// the cache while it runs.  A scan-resistant cache keeps the
+// directory and inode blocks.
+void
+mixed(void)
+{
+  static char *names[] = { "README", "cat", "ls", "sh" };
+  uint h0, m0, h1, m1;
+  int i, k, fd, sfd, f, n = 200;
+
+  wsfiles(1);
+  bcstat(&h0, &m0);
+  sfd = -1;
+  f = 0;
+  start();
+  for(i = 0; i < n; i++){
+    for(k = 0; k < 8; k++){
+      if(sfd < 0 || read(sfd, buf, 1024) != 1024){
+        close(sfd);
+        wsname[7] = '0' + f++ % NWSFILE;
+        if((sfd = open(wsname, O_RDONLY)) < 0)
+          die("open");
+      }
+    }
+    if((fd = open(names[i % 4], O_RDONLY)) < 0)
+      die("open");
+    close(fd);
+  }
+  stop("mixed_open", n);
+  close(sfd);
+  bcstat(&h1, &m1);
+  h1 -= h0;
+  m1 -= m0;
+  printf(1, "bench: mixed_hits %d %d%% hit\n", h1 + m1,
+         h1 + m1 ? h1 * 100 / (h1 + m1) : 0);
+  wsfiles(0);
+}
+
+// Grow memory, touch every page, and shrink it again.
+void
+sbrkfault(void)
+{
+  int i, j, npg = 64, reps = 10;
+  char *a;
+
+  start();
+  for(j = 0; j < reps; j++){
+    if((a = sbrk(npg*4096)) == (char*)-1)
+      die("sbrk");
+    for(i = 0; i < npg; i++)
+      a[i*4096] = 1;
+    sbrk(-npg*4096);
+  }
+  stop("sbrk_page", reps*npg);
+}
+
+struct {
+  char *name;
+  void (*fn)(void);
+} tests[] = {
+  { "null", null },
+  { "fork", forkexit },
+  { "exec", forkexec },
+  { "spawn", spawnwait },
+  { "pipe", pipelat },
+  { "pipebw", pipebw },
+  { "file", createdelete },
+  { "seq", seqio },
+  { "rand", randio },
+  { "ws", wsread },
+  { "mixed", mixed },
+  { "pread", parread },
+  { "sbrk", sbrkfault },
+};
+
+int
+main(int argc, char *argv[])
+{
+  int i, j;
+
+  if(argc > 1 && strcmp(argv[1], "exit") == 0)
+    exit();  // for fork_exec
+  calibrate();
+  for(i = 0; i < sizeof(tests)/sizeof(tests[0]); i++){
+    if(argc > 1){
+      for(j = 1; j < argc; j++)
+        if(strcmp(argv[j], tests[i].name) == 0)
+          break;
+      if(j == argc)
+        continue;
+    }
+    tests[i].fn();
+  }
+  printf(1, "bench: done\n");
+  exit();
+}
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a set of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,6 +17,33 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// The cache always has the NBUF buffers in bcache.buf.  While more
+// than BCACHEFREE pages of memory are free, a miss that would evict
+// a cached block adds a page of buffers from kalloc() instead, and
+// when kalloc() runs out of memory, breclaim() gives back the pages
+// whose buffers are all unused.  If every buffer is in use and no
+// memory is left, bget() waits for one to be released.
+//
+// Blocks are replaced by the 2Q policy, so that reading a big file
+// once does not push out the inode, directory and bitmap blocks
+// that are used again and again.  A block read for the first time
+// goes on the cold list, which is first in, first out: using it
+// again while it is there does not move it.  A block evicted from
+// the cold list is remembered in the ghost ring, and if it is read
+// again while it is remembered, it goes on the hot list, which is
+// least recently used.  The cold list gives up its oldest buffer
+// while it holds more than a quarter of the buffers; otherwise the
+// hot list gives up the one used least recently.
+//
+// A block used several times while it is still on the cold list is
+// deliberately not promoted: reading a file in pieces smaller than
+// a block uses each block several times in a row, and that alone
+// should not make a streamed file hot.
+//
+// File system metadata below the data blocks (the superblock, log,
+// inode and bitmap blocks) goes straight on the hot list, and the
+// superblock and bitmap blocks are never evicted.
 
 #include "types.h"
 #include "defs.h"
@@ -25,72 +52,235 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "mmu.h"
+#include "proc.h"
+
+extern struct superblock sb;
+
+// A page of buffers, beyond the NBUF that are always there.
+struct bufpage {
+  struct bufpage *next;
+  struct buf buf[(PGSIZE - sizeof(struct bufpage*)) / sizeof(struct buf)];
+};
+#define BUFPERPG NELEM(((struct bufpage*)0)->buf)
 
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
+  struct bufpage *pages;     // allocated buffers
+  int nbuf;                  // buffers in the cache
+  int nhot;                  // buffers on the hot list
+  int nwait;                 // bget()s waiting for a buffer
+  uint nhit, nmiss, nevict;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+  // Lists of buffers, through prev/next.
+  // head.next is the newest or most recently used.
+  struct buf cold;
+  struct buf hot;
+
+  // Blocks evicted from the cold list, oldest at ghostpos.
+  struct {
+    uint dev, blockno;
+  } ghost[NBGHOST];
+  int ghostpos;
 } bcache;
 
+// Take b off its list.
+static void
+bdetach(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+}
+
+// Put b at the front of list.
+static void
+battach(struct buf *list, struct buf *b)
+{
+  b->next = list->next;
+  b->prev = list;
+  list->next->prev = b;
+  list->next = b;
+}
+
 void
 binit(void)
 {
   struct buf *b;
 
   initlock(&bcache.lock, "bcache");
+  bcache.nbuf = NBUF;
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
+  // Create linked lists of buffers
+  bcache.cold.prev = &bcache.cold;
+  bcache.cold.next = &bcache.cold;
+  bcache.hot.prev = &bcache.hot;
+  bcache.hot.next = &bcache.hot;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    battach(&bcache.cold, b);
   }
 }
 
+// A buffer became free to recycle, or there is memory to add
+// some: wake bget()s waiting for one.  Caller holds bcache.lock.
+static void
+bavail(void)
+{
+  if(bcache.nwait > 0)
+    wakeup(&bcache);
+}
+
+// Add a page of buffers to the old end of the cold list, where
+// bget() takes them first.  Caller holds bcache.lock, which is
+// released while kalloc() runs.  Returns 0 if there is no memory.
+static int
+bgrow(void)
+{
+  struct bufpage *pg;
+  struct buf *b;
+
+  release(&bcache.lock);
+  pg = (struct bufpage*)kalloc();
+  acquire(&bcache.lock);
+  if(pg == 0)
+    return 0;
+  memset(pg, 0, PGSIZE);
+  for(b = pg->buf; b < &pg->buf[BUFPERPG]; b++){
+    initsleeplock(&b->lock, "buffer");
+    battach(bcache.cold.prev, b);
+  }
+  pg->next = bcache.pages;
+  bcache.pages = pg;
+  bcache.nbuf += BUFPERPG;
+  bavail();
+  return 1;
+}
+
+// Is block blockno file system metadata?
+static int
+bmeta(uint blockno)
+{
+  return blockno < sb.bmapstart + sb.size/BPB + 1;
+}
+
+// Is b the superblock or a bitmap block, which stay cached?
+static int
+bpinned(struct buf *b)
+{
+  return (b->flags & B_VALID) && (b->blockno == 1 ||
+    (b->blockno >= sb.bmapstart && b->blockno < sb.bmapstart + sb.size/BPB + 1));
+}
+
+// The oldest unused buffer on list, or 0.
+// Even if refcnt==0, B_DIRTY indicates a buffer is in use
+// because log.c has modified it but not yet committed it.
+static struct buf*
+bunused(struct buf *list)
+{
+  struct buf *b;
+
+  for(b = list->prev; b != list; b = b->prev)
+    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0 && !bpinned(b))
+      return b;
+  return 0;
+}
+
+// Choose the buffer to recycle, by the 2Q policy, or 0.
+static struct buf*
+bvictim(void)
+{
+  struct buf *b, *h;
+
+  b = bunused(&bcache.cold);
+  if(b && (b->flags & B_VALID) == 0)
+    return b;  // never used
+  if((b == 0 || bcache.nbuf - bcache.nhot <= bcache.nbuf/4) &&
+     (h = bunused(&bcache.hot)) != 0)
+    return h;
+  return b;
+}
+
+// Was the block evicted from the cold list lately?
+// If so, forget it.
+static int
+bghost(uint dev, uint blockno)
+{
+  int i;
+
+  for(i = 0; i < NBGHOST; i++)
+    if(bcache.ghost[i].dev == dev && bcache.ghost[i].blockno == blockno){
+      bcache.ghost[i].dev = 0;
+      return 1;
+    }
+  return 0;
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct buf *b, *list;
+  int grew;
 
   acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+  grew = 0;
+  for(;;){
+    // Is the block already cached?
+    for(list = &bcache.cold; ; list = &bcache.hot){
+      for(b = list->next; b != list; b = b->next){
+        if(b->dev == dev && b->blockno == blockno){
+          b->refcnt++;
+          bcache.nhit++;
+          release(&bcache.lock);
+          acquiresleep(&b->lock);
+          return b;
+        }
+      }
+      if(list == &bcache.hot)
+        break;
     }
-  }
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
+    // Not cached; recycle an unused buffer, unless that would
+    // evict a block and there is memory to add buffers instead.
+    b = bvictim();
+    if(b && ((b->flags & B_VALID) == 0 || grew ||
+             kfreecount() <= BCACHEFREE)){
+      if(b->flags & B_VALID){
+        bcache.nevict++;
+        if(!b->hot){
+          bcache.ghost[bcache.ghostpos].dev = b->dev;
+          bcache.ghost[bcache.ghostpos].blockno = b->blockno;
+          bcache.ghostpos = (bcache.ghostpos + 1) % NBGHOST;
+        }
+      }
+      bcache.nmiss++;
+      bdetach(b);
+      bcache.nhot -= b->hot;
+      b->hot = bghost(dev, blockno) || bmeta(blockno);
+      bcache.nhot += b->hot;
+      battach(b->hot ? &bcache.hot : &bcache.cold, b);
       b->dev = dev;
       b->blockno = blockno;
       b->flags = 0;
       b->refcnt = 1;
-      release(&bcache.lock);  // bcache.lock 保护的是所有 buffer 的元数据
-      // 这个时候可以释放 bcache 的锁了，因为 refcnt 已经>=1，能保护 buf 不被用于缓存别的 block 了
-      acquiresleep(&b->lock); // buffer.lock 保护的是 buffer 的数据
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
       return b;
     }
+
+    // bgrow() released the lock, so look again.
+    if(bgrow() || b){
+      grew = 1;
+      continue;
+    }
+    bcache.nwait++;
+    sleep(&bcache, &bcache.lock);
+    bcache.nwait--;
   }
-  panic("bget: no buffers");  // 就是说这里会出现 buffer 不够用的情况，这时候 panic
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -102,6 +292,8 @@ bread(uint dev, uint blockno)
   b = bget(dev, blockno);
   if((b->flags & B_VALID) == 0) {
     iderw(b);
+    if(myproc())
+      myproc()->acct.inblock++;
   }
   return b;
 }
@@ -114,10 +306,13 @@ bwrite(struct buf *b)
     panic("bwrite");
   b->flags |= B_DIRTY;
   iderw(b);
+  if(myproc())
+    myproc()->acct.oublock++;
 }
 
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// A hot buffer moves to the head of the hot list; a cold
+// one keeps its place.
 void
 brelse(struct buf *b)
 {
@@ -130,16 +325,75 @@ brelse(struct buf *b)
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;   // bcache.head 本身是不使用的，只是为了找 buffer 项方便
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    if(b->hot){
+      bdetach(b);
+      battach(&bcache.hot, b);
+    }
+    bavail();
   }
   
   release(&bcache.lock);
 }
+
+// Free the pages of buffers that are all unused, when memory
+// runs out.  Returns the number of pages freed.
+int
+breclaim(void)
+{
+  struct bufpage *pg, **pp;
+  struct buf *b;
+  int n;
+
+  n = 0;
+  acquire(&bcache.lock);
+  for(pp = &bcache.pages; (pg = *pp) != 0; ){
+    for(b = pg->buf; b < &pg->buf[BUFPERPG]; b++)
+      if(b->refcnt > 0 || (b->flags & B_DIRTY) || bpinned(b))
+        break;
+    if(b < &pg->buf[BUFPERPG]){
+      pp = &pg->next;
+      continue;
+    }
+    for(b = pg->buf; b < &pg->buf[BUFPERPG]; b++){
+      bdetach(b);
+      bcache.nhot -= b->hot;
+    }
+    *pp = pg->next;
+    bcache.nbuf -= BUFPERPG;
+    kfree((char*)pg);
+    n++;
+  }
+  if(n > 0)
+    bavail();  // a waiter's bgrow() may succeed now
+  release(&bcache.lock);
+  return n;
+}
+
+// b's contents are on the disk: clear B_DIRTY, which may make
+// b free to recycle.  Called by the disk driver.
+void
+bclean(struct buf *b)
+{
+  acquire(&bcache.lock);
+  b->flags &= ~B_DIRTY;
+  if(b->refcnt == 0)
+    bavail();
+  release(&bcache.lock);
+}
+
+// Report the buffers, the hot ones, and the hits, misses
+// and evictions, for /proc/bcache.
+void
+bstat(uint *nbuf, uint *nhot, uint *nhit, uint *nmiss, uint *nevict)
+{
+  acquire(&bcache.lock);
+  *nbuf = bcache.nbuf;
+  *nhot = bcache.nhot;
+  *nhit = bcache.nhit;
+  *nmiss = bcache.nmiss;
+  *nevict = bcache.nevict;
+  release(&bcache.lock);
+}
 //PAGEBREAK!
 // Blank page.
 
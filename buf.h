@@ -4,6 +4,7 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
+  int hot;          // on the hot list (see bio.c)
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
@@ -0,0 +1,72 @@
+// Console output benchmark.
+// nproc processes each write kbytes of lines to the console while
+// another process spins, and conbench prints the ticks the output
+// took and how many rounds the spinner got through meanwhile, which
+// shows how much CPU time the writers left for others.  Compare
+// with conbench 0 for the spinner alone.
+// Usage: conbench [nproc [kbytes]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "poll.h"
+
+char line[64];
+
+// Count rounds of busy work until ctl becomes readable,
+// then write the count to res.
+void
+spinner(int ctl, int res)
+{
+  struct pollfd pfd;
+  volatile int j;
+  int rounds;
+
+  pfd.fd = ctl;
+  pfd.events = POLLIN;
+  for(rounds = 0; poll(&pfd, 1, 0) == 0; rounds++)
+    for(j = 0; j < 10000; j++)
+      ;
+  write(res, &rounds, sizeof(rounds));
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, kb, i, n, rounds, ctl[2], res[2];
+  uint t;
+
+  nproc = argc > 1 ? atoi(argv[1]) : 1;
+  kb = argc > 2 ? atoi(argv[2]) : 32;
+  memset(line, 'x', sizeof(line));
+  line[sizeof(line)-1] = '\n';
+
+  if(pipe(ctl) < 0 || pipe(res) < 0){
+    printf(2, "conbench: pipe failed\n");
+    exit();
+  }
+  if(fork() == 0)
+    spinner(ctl[0], res[1]);
+
+  t = uptime();
+  for(i = 0; i < nproc; i++){
+    if(fork() == 0){
+      for(n = 0; n < kb*1024; n += sizeof(line))
+        write(1, line, sizeof(line));
+      exit();
+    }
+  }
+  for(i = 0; i < nproc; i++)
+    wait();
+  if(nproc == 0)
+    sleep(100);
+  t = uptime() - t;
+  write(ctl[1], "x", 1);
+  if(read(res[0], &rounds, sizeof(rounds)) != sizeof(rounds))
+    rounds = -1;
+  wait();
+  printf(2, "conbench: %d procs wrote %d KB in %d ticks; spinner %d rounds\n",
+         nproc, nproc*kb, t, rounds);
+  exit();
+}
@@ -14,6 +14,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "poll.h"
 
 static void consputc(int);
 
@@ -25,7 +26,7 @@ static struct {
 } cons;
 
 static void
-printint(int xx, int base, int sign)
+printint(struct klogbuf *kb, int xx, int base, int sign)
 {
   static char digits[] = "0123456789abcdef";
   char buf[16];
@@ -46,29 +47,29 @@ printint(int xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    klogputc(kb, buf[i]);
 }
 //PAGEBREAK: 50
 
 // Print to the console. only understands %d, %x, %p, %s.
+// The message goes to this CPU's kernel log ring and reaches
+// the console when klog.c next drains it.
 void
 cprintf(char *fmt, ...)
 {
-  int i, c, locking;
+  struct klogbuf *kb;
+  int i, c;
   uint *argp;
   char *s;
 
-  locking = cons.locking;
-  if(locking)
-    acquire(&cons.lock);
-
   if (fmt == 0)
     panic("null fmt");
 
+  kb = klogbegin();
   argp = (uint*)(void*)(&fmt + 1);
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
-      consputc(c);
+      klogputc(kb, c);
       continue;
     }
     c = fmt[++i] & 0xff;
@@ -76,29 +77,46 @@ cprintf(char *fmt, ...)
       break;
     switch(c){
     case 'd':
-      printint(*argp++, 10, 1);
+      printint(kb, *argp++, 10, 1);
       break;
     case 'x':
     case 'p':
-      printint(*argp++, 16, 0);
+      printint(kb, *argp++, 16, 0);
       break;
     case 's':
       if((s = (char*)*argp++) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        klogputc(kb, *s);
       break;
     case '%':
-      consputc('%');
+      klogputc(kb, '%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      klogputc(kb, '%');
+      klogputc(kb, c);
       break;
     }
   }
+  klogend(kb);
+
+  // Before consoleinit() and in panic(), print now.
+  if(!cons.locking)
+    klogflush();
+}
+
+// Print n bytes of kernel log.  Called by klog.c.
+void
+conslog(char *buf, int n)
+{
+  int i, locking;
 
+  locking = cons.locking;
+  if(locking)
+    acquire(&cons.lock);
+  for(i = 0; i < n; i++)
+    consputc(buf[i] & 0xff);
   if(locking)
     release(&cons.lock);
 }
@@ -111,6 +129,7 @@ panic(char *s)
 
   cli();
   cons.locking = 0;
+  klogflush();  // what was logged before the panic
   // use lapiccpunum so that we can call panic from mycpu()
   cprintf("lapicid %d: panic: ", lapicid());
   cprintf(s);
@@ -171,7 +190,12 @@ consputc(int c)
       ;
   }
 
-  if(c == BACKSPACE){
+  if(!cons.locking){  // panic; other CPUs may hold the uart lock
+    if(c == BACKSPACE){
+      uartputc_sync('\b'); uartputc_sync(' '); uartputc_sync('\b');
+    } else
+      uartputc_sync(c);
+  } else if(c == BACKSPACE){
     uartputc('\b'); uartputc(' '); uartputc('\b');
   } else
     uartputc(c);
@@ -184,6 +208,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  struct pollq pollq;  // woken when a line is ready
 } input;
 
 #define C(x)  ((x)-'@')  // Control-x
@@ -221,6 +246,7 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          pollwakeup(&input.pollq);
         }
       }
       break;
@@ -233,7 +259,7 @@ consoleintr(int (*getc)(void))
 }
 
 int
-consoleread(struct inode *ip, char *dst, int n)
+consoleread(struct inode *ip, char *dst, uint off, int n)
 {
   uint target;
   int c;
@@ -270,16 +296,37 @@ consoleread(struct inode *ip, char *dst, int n)
   return target - n;
 }
 
+int
+consolepoll(struct inode *ip)
+{
+  int r;
+
+  acquire(&cons.lock);
+  r = POLLOUT;
+  if(input.r != input.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
   int i;
 
   iunlock(ip);
+  if(panicked){
+    cli();
+    for(;;)
+      ;
+  }
   acquire(&cons.lock);
   for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
+    cgaputc(buf[i] & 0xff);
   release(&cons.lock);
+  // Queue for the serial port without cons.lock, so
+  // cprintf on other CPUs need not wait for the line.
+  uartwrite(buf, n);
   ilock(ip);
 
   return n;
@@ -292,6 +339,8 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
+  devsw[CONSOLE].pollq = &input.pollq;
   cons.locking = 1;
 
   ioapicenable(IRQ_KBD, 0);
@@ -1,29 +1,45 @@
+struct aioctx;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct klogbuf;
 struct pipe;
+struct pollq;
 struct proc;
+struct pstat;
 struct rtcdate;
+struct spawnact;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
 
+// aio.c
+int             aioenter(int);
+void            aioinit(void);
+void            aiorelease(struct proc*);
+int             aiosetup(int);
+
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+int             breclaim(void);
+void            bclean(struct buf*);
+void            bstat(uint*, uint*, uint*, uint*, uint*);
 
 // console.c
 void            consoleinit(void);
 void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
+void            conslog(char*, int);
 
 // exec.c
 int             exec(char*, char**);
+int             spawn(char*, char**, struct spawnact*, int);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +49,16 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filepoll(struct file*);
+int             filepread(struct file*, char*, int, uint);
+int             filepwrite(struct file*, char*, int, uint);
+struct pollq*   filepollq(struct file*);
+void            pollbegin(void);
+int             pollregister(struct pollq*);
+void            pollsleep(void);
+void            pollunregister(struct pollq*);
+void            pollwakeup(struct pollq*);
+extern struct pollq tickpollq;
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -42,6 +68,7 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
@@ -65,28 +92,57 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
+int             kprezero(void);
 void            kfree(char*);
+void            kincref(char*);
+int             kref(char*);
+int             kfreecount(void);
+int             kcommit(int);
+void            kuncommit(int);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kinit2cpu(void);
+extern char     zeropage[];
 
 // kbd.c
 void            kbdintr(void);
 
+// klog.c
+struct klogbuf* klogbegin(void);
+void            klogdrain(void);
+void            klogend(struct klogbuf*);
+void            klogflush(void);
+void            kloginit(void);
+void            klogputc(struct klogbuf*, int);
+int             kmsgread(struct inode*, char*, uint, int);
+int             kmsgwrite(struct inode*, char*, int);
+
+// ksm.c
+void            ksminit(void);
+int             ksmreclaim(void);
+void            ksmsetrate(uint);
+void            ksmstat(uint*, uint*, uint*, uint*);
+
 // lapic.c
 void            cmostime(struct rtcdate *r);
 int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
-void            lapicstartap(uchar, uint);
+void            lapicstartaps(uint);
 void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+void            log_flush(void);
 void            begin_op();
 void            end_op();
 
+// main.c
+char*           bootphase(int, uint64*, uint64*);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
@@ -98,32 +154,56 @@ void            picinit(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             piperead(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, char*, int, int);
+int             pipepoll(struct pipe*, int);
+struct pollq*   pipepollq(struct pipe*);
 
 //PAGEBREAK: 16
+// procfs.c
+void            procfsinit(void);
+int             procfsread(struct inode*, char*, uint, int);
+int             procfswrite(struct inode*, char*, int);
+
 // proc.c
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+struct proc*    kthread_create(char*, void (*)(void*), void*);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
+int             procstat(int, struct pstat*);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
+pde_t*          setuvm(pde_t*, uint);
+int             spawnproc(pde_t*, uint, uint, uint, char*,
+                          struct spawnact*, int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
+char*           swapvictim(pte_t);
+struct proc*    pinproc(int);
+void            unpinproc(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// shm.c
+void            shminit(void);
+int             shmget(int, int);
+int             shmat(int);
+int             shmdt(uint);
+void            shmfork(struct proc*, struct proc*);
+void            shmrelease(struct proc*);
+void            shmtrim(struct proc*, uint);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -135,8 +215,11 @@ void            popcli(void);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+int             holdingsleepany(struct sleeplock*);
+void            sleeplockstat(uint*, uint*, uint*, uint*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -148,20 +231,39 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(void);
+int             swapin(pde_t*, uint);
+int             swapout(void);
+void            swapfree(pte_t);
+void            swapstat(uint*, uint*, uint*, uint*);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argptrw(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
+// sysfile.c
+int             fileopen(struct file*, char*, int);
+
 // timer.c
 void            timerinit(void);
 
+// text.c
+void            textinit(void);
+int             textmap(pde_t*, uint, struct inode*, uint, uint);
+void            textinval(struct inode*);
+int             textreclaim(void);
+
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+uint64          tsc2us(uint64);
+extern uint     tsctick;
 void            tvinit(void);
 extern struct spinlock tickslock;
 
@@ -169,6 +271,8 @@ extern struct spinlock tickslock;
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartputc_sync(int);
+void            uartwrite(char*, int);
 
 // vm.c
 void            seginit(void);
@@ -178,6 +282,13 @@ char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             cowfault(pde_t*, uint);
+int             growstack(struct proc*, uint);
+int             uvmtouch(struct proc*, uint, int);
+char*           kstackalloc(void);
+void            kstackfree(char*);
+int             vmreclaim(void);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
@@ -185,6 +296,8 @@ void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             shareuvm(pde_t*, uint, uint, int);
+int             uvmresident(pde_t*, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,23 @@
+// Print the kernel log kept by the kmsg device.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+char buf[512];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, n;
+
+  if((fd = open("/kmsg", O_RDONLY)) < 0){
+    printf(2, "dmesg: cannot open /kmsg\n");
+    exit();
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+  exit();
+}
@@ -7,26 +7,27 @@
 #include "x86.h"
 #include "elf.h"
 
-int
-exec(char *path, char **argv)
+// Load the program in path into a new page table, with the
+// strings of argv on its stack.  Returns the page table and sets
+// *szp, *entryp and *spp, or returns 0 on error.
+static pde_t*
+loadprog(char *path, char **argv, uint *szp, uint *entryp, uint *spp)
 {
-  char *s, *last;
-  int i, off;
+  int i, off, end;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
-  struct proc *curproc = myproc();
+  pde_t *pgdir;
 
   begin_op();
 
   if((ip = namei(path)) == 0){
     end_op();
     cprintf("exec: fail\n");
-    return -1;
+    return 0;
   }
-  ilock(ip);
+  ilockshared(ip);
   pgdir = 0;
 
   // Check ELF header
@@ -49,10 +50,22 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
-      goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    // Map the file's part of the segment from the text cache
+    // if it can, and allocate the rest; else load a private copy.
+    if(ph.vaddr > sz && (sz = allocuvm(pgdir, sz, ph.vaddr)) == 0)
+      goto bad;
+    if(ph.vaddr >= sz && (end = textmap(pgdir, ph.vaddr, ip, ph.off, ph.filesz)) != 0){
+      if(end < 0)
+        goto bad;
+      sz = end;
+      if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+        goto bad;
+      continue;
+    }
+    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+      goto bad;
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
@@ -60,12 +73,18 @@ exec(char *path, char **argv)
   end_op();
   ip = 0;
 
-  // Allocate two pages at the next page boundary.
-  // Make the first inaccessible.  Use the second as the user stack.
+  // Allocate a page at the next page boundary and make it
+  // inaccessible, as a guard.  Reserve USTACKSIZE bytes above it
+  // for the user stack.  Only the top page of the stack is
+  // allocated; the rest is added as the stack grows down into it
+  // (see growstack()).
   sz = PGROUNDUP(sz);
-  if((sz = allocuvm(pgdir, sz, sz + 2*PGSIZE)) == 0)
+  if((sz = allocuvm(pgdir, sz, sz + PGSIZE)) == 0)
+    goto bad;
+  clearpteu(pgdir, (char*)(sz - PGSIZE));
+  sz += USTACKSIZE;
+  if((sz = allocuvm(pgdir, sz - PGSIZE, sz)) == 0)
     goto bad;
-  clearpteu(pgdir, (char*)(sz - 2*PGSIZE));
   sp = sz;
 
   // Push argument strings, prepare rest of stack in ustack.
@@ -87,28 +106,72 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
-  // Save program name for debugging.
+  *szp = sz;
+  *entryp = elf.entry;
+  *spp = sp;
+  return pgdir;
+
+ bad:
+  if(pgdir)
+    freevm(pgdir);
+  if(ip){
+    iunlockput(ip);
+    end_op();
+  }
+  return 0;
+}
+
+// The last element of path, for the process name.
+static char*
+progname(char *path)
+{
+  char *s, *last;
+
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(curproc->name, last, sizeof(curproc->name));
+  return last;
+}
+
+int
+exec(char *path, char **argv)
+{
+  uint sz, entry, sp;
+  pde_t *pgdir, *oldpgdir;
+  struct proc *curproc = myproc();
+
+  if((pgdir = loadprog(path, argv, &sz, &entry, &sp)) == 0)
+    return -1;
+
+  // Save program name for debugging.
+  safestrcpy(curproc->name, progname(path), sizeof(curproc->name));
 
   // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
-  curproc->tf->eip = elf.entry;  // main
+  shmrelease(curproc);
+  aiorelease(curproc);
+  curproc->tf->eip = entry;  // main
   curproc->tf->esp = sp;
-  switchuvm(curproc);
+  curproc->ustack = sz - USTACKSIZE;
+  oldpgdir = setuvm(pgdir, sz);
   freevm(oldpgdir);
   return 0;
+}
 
- bad:
-  if(pgdir)
+// Start the program in path in a new child process.  The child
+// gets a fresh image and never a copy of this process's memory,
+// so this is fork() and exec() without the copy, and errors in
+// either come back to the caller.  act changes the open files
+// the child inherits, as a shell's redirections would.
+int
+spawn(char *path, char **argv, struct spawnact *act, int nact)
+{
+  uint sz, entry, sp;
+  pde_t *pgdir;
+  int pid;
+
+  if((pgdir = loadprog(path, argv, &sz, &entry, &sp)) == 0)
+    return -1;
+  if((pid = spawnproc(pgdir, sz, entry, sp, progname(path), act, nact)) < 0)
     freevm(pgdir);
-  if(ip){
-    iunlockput(ip);
-    end_op();
-  }
-  return -1;
+  return pid;
 }
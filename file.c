@@ -6,9 +6,13 @@
 #include "defs.h"
 #include "param.h"
 #include "fs.h"
+#include "mmu.h"
+#include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "stat.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -16,10 +20,17 @@ struct {
   struct file file[NFILE];
 } ftable;   // 打开文件表，用一个自旋锁保护
 
+// polllock protects every pollq and proc->pollev, so that an
+// object becoming ready between poll()'s scan and its sleep
+// is not missed.
+struct spinlock polllock;
+struct pollq tickpollq;  // woken every clock tick, for poll() timeouts
+
 void
 fileinit(void)  // 打开文件表的初始化：初始化打开文件表的锁
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&polllock, "poll");
 }
 
 // 分配一个file结构：从打开文件表中找到一个空闲的文件表项，返回指向该表项的指针；失败返回 0
@@ -85,7 +96,7 @@ int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);     // ip indicates inode pointer
+    ilockshared(f->ip);     // ip indicates inode pointer
     stati(f->ip, st);
     iunlock(f->ip);
     return 0;
@@ -93,6 +104,120 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+//PAGEBREAK!
+// Poll wait queues.
+//
+// poll() calls pollbegin(), registers on the pollq of each file
+// with pollregister(), checks each file with filepoll(), and if
+// nothing is ready calls pollsleep().  A pipe or device calls
+// pollwakeup() on its pollq whenever it may have become ready.
+
+void
+pollbegin(void)
+{
+  acquire(&polllock);
+  myproc()->pollev = 0;
+  release(&polllock);
+}
+
+// Add the current process to q.
+// Returns -1 if q is full.
+int
+pollregister(struct pollq *q)
+{
+  struct proc *p = myproc();
+  int i, free;
+
+  acquire(&polllock);
+  free = -1;
+  for(i = 0; i < NPOLLQ; i++){
+    if(q->proc[i] == p){
+      release(&polllock);
+      return 0;
+    }
+    if(q->proc[i] == 0 && free < 0)
+      free = i;
+  }
+  if(free >= 0)
+    q->proc[free] = p;
+  release(&polllock);
+  return free >= 0 ? 0 : -1;
+}
+
+void
+pollunregister(struct pollq *q)
+{
+  struct proc *p = myproc();
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < NPOLLQ; i++)
+    if(q->proc[i] == p)
+      q->proc[i] = 0;
+  release(&polllock);
+}
+
+// Sleep until a pollq the current process is on is woken.
+void
+pollsleep(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&polllock);
+  while(p->pollev == 0 && !p->killed)
+    sleep(&p->pollev, &polllock);
+  release(&polllock);
+}
+
+// Wake every process polling q.
+void
+pollwakeup(struct pollq *q)
+{
+  struct proc *p;
+  int i;
+
+  acquire(&polllock);
+  for(i = 0; i < NPOLLQ; i++){
+    if((p = q->proc[i]) != 0){
+      p->pollev = 1;
+      wakeup(&p->pollev);
+    }
+  }
+  release(&polllock);
+}
+
+// Return the queue that is woken when f may become ready,
+// or 0 if f never blocks.
+struct pollq*
+filepollq(struct file *f)
+{
+  if(f->type == FD_PIPE)
+    return pipepollq(f->pipe);
+  if(f->type == FD_INODE && f->ip->type == T_DEV &&
+     f->ip->major >= 0 && f->ip->major < NDEV)
+    return devsw[f->ip->major].pollq;
+  return 0;
+}
+
+// Return the POLL* events ready on f.
+int
+filepoll(struct file *f)
+{
+  int r;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable);
+  r = POLLIN|POLLOUT;
+  if(f->type == FD_INODE && f->ip->type == T_DEV &&
+     f->ip->major >= 0 && f->ip->major < NDEV && devsw[f->ip->major].poll)
+    r = devsw[f->ip->major].poll(f->ip);
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
+
 // Read from file f. 把文件 *f 读到 addr 中，从 f_off 出开始读，n 是读取的字节数
 int
 fileread(struct file *f, char *addr, int n)
@@ -102,9 +227,16 @@ fileread(struct file *f, char *addr, int n)
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return piperead(f->pipe, addr, n, f->nonblock);
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    if(f->nonblock && (filepoll(f) & POLLIN) == 0)
+      return -1;
+    // The lock also guards f->off, so share it only if no other
+    // process can use f, and so read at the same offset.
+    if(f->ref == 1)
+      ilockshared(f->ip);
+    else
+      ilock(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0) // 读 iNode 时要求 caller 持有 iNode 锁
       f->off += r;
     iunlock(f->ip);
@@ -113,46 +245,79 @@ fileread(struct file *f, char *addr, int n)
   panic("fileread");
 }
 
+// Read from file f at offset off, leaving f->off alone.
+// Only inodes have offsets.
+int
+filepread(struct file *f, char *addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilockshared(f->ip);
+  r = readi(f->ip, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
 //PAGEBREAK!
+// Write n bytes to inode file f at *off, advancing *off.
+static int
+inodewrite(struct file *f, char *addr, int n, uint *off)
+{
+  int r;
+
+  // write a few blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+
+    begin_op();
+    ilock(f->ip);
+    if ((r = writei(f->ip, addr + i, *off, n1)) > 0)
+      *off += r;
+    iunlock(f->ip);
+    end_op();
+
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filewrite");
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Write to file f.
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
-
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+    return pipewrite(f->pipe, addr, n, f->nonblock);
   if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
-    }
-    return i == n ? n : -1;
+    if(f->nonblock && (filepoll(f) & POLLOUT) == 0)
+      return -1;
+    return inodewrite(f, addr, n, &f->off);
   }
   panic("filewrite");
 }
 
+// Write to file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return inodewrite(f, addr, n, &off);
+}
+
@@ -3,6 +3,7 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;  // O_NONBLOCK: fail reads and writes that would sleep
   struct pipe *pipe;
   struct inode *ip;
   uint off;
@@ -25,13 +26,23 @@ struct inode {
   uint addrs[NDIRECT+1];  // NDIRECT个直接块，加上一个间接块，是所有用于存放地址的块的个数
 };
 
+// Processes sleeping in poll() on a pipe or device.
+// Protected by polllock in file.c.
+struct pollq {
+  struct proc *proc[NPOLLQ];
+};
+
 // table mapping major device number to
 // device functions
 struct devsw {
-  int (*read)(struct inode*, char*, int);
+  int (*read)(struct inode*, char*, uint, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*);  // ready POLL* events (null: always ready)
+  struct pollq *pollq;         // woken when poll() result may change
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define KMSG    2
+#define PROCFS  3
@@ -1,4 +1,5 @@
-// Test that fork fails gracefully.
+// Test that fork fails gracefully, then report how many
+// fork/exit/wait round trips a second the kernel manages.
 // Tiny executable so that the limit can be filling the proc table.
 
 #include "types.h"
@@ -48,9 +49,46 @@ forktest(void)
   printf(1, "fork test OK\n");
 }
 
+void
+printnum(uint x)
+{
+  char num[11];
+  int i;
+
+  i = sizeof(num);
+  do{
+    num[--i] = '0' + x % 10;
+  }while((x /= 10) != 0);
+  write(1, num + i, sizeof(num) - i);
+}
+
+void
+forkrate(void)
+{
+  int n, pid;
+  uint t;
+
+  t = uptime();
+  for(n = 0; n < N; n++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+  t = uptime() - t;
+  printf(1, "fork rate: ");
+  printnum(N*100 / (t ? t : 1));  // 100 ticks a second
+  printf(1, " forks/s\n");
+}
+
 int
 main(void)
 {
   forktest();
+  forkrate();
   exit();
 }
@@ -313,11 +313,30 @@ ilock(struct inode *ip)
   }
 }
 
-// 解锁给定的iNode
+// Lock the given inode shared, for reading: other processes
+// may hold it shared too, but none exclusively.
+// Reads the inode from disk if necessary.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  while(ip->valid == 0){
+    // Reading it in takes the lock exclusively.
+    releasesleep(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// 解锁给定的iNode，无论是独占还是共享地锁定的
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)  // 空指针、没有持有锁、引用计数小于1，都是不合法的
+  if(ip == 0 || !holdingsleepany(&ip->lock) || ip->ref < 1)  // 空指针、没有持有锁、引用计数小于1，都是不合法的
     panic("iunlock");
 
   releasesleep(&ip->lock);
@@ -433,6 +452,7 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  textinval(ip);
 }
 
 // Copy stat information from inode.
@@ -459,7 +479,7 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   if(ip->type == T_DEV){  // T_DEV 3, 表示设备文件
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
-    return devsw[ip->major].read(ip, dst, n);
+    return devsw[ip->major].read(ip, dst, off, n);
   }
 
   if(off > ip->size || off + n < off) // 等价于n<0?
@@ -496,6 +516,8 @@ writei(struct inode *ip, char *src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE) // MAXFILE是一个文件最多可包含的块数，BSIZE是一个块的字节数
     return -1;
 
+  if(n > 0)
+    textinval(ip);
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
@@ -638,7 +660,7 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);   // 相对路径，从当前目录开始找
 
   while((path = skipelem(path, name)) != 0){// 将path中的下一个路径元素复制到name中。返回指向复制元素后面的元素的指针新*path。
-    ilock(ip);
+    ilockshared(ip);
     if(ip->type != T_DIR){  // inode不是目录文件，解锁并put inode，返回0
       iunlockput(ip);
       return 0;
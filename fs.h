@@ -19,8 +19,13 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint swapstart;    // Block number of first swap block
+  uint nswap;        // Number of swap blocks
 };
 
+// Swap space follows the file system on the disk.
+#define SWAPSIZE (NSWAPPG*(4096/BSIZE))  // blocks
+
 #define NDIRECT 12
 #define NINDIRECT (BSIZE / sizeof(uint))  // block编号是uint类型，所以一个block可以存放BSIZE/sizeof(uint)个block编号
 #define MAXFILE (NDIRECT + NINDIRECT) // NINDIRECT个block编号，加上NDIRECT个直接存放的block编号，就是一个文件最多可以存放的block编号个数
@@ -75,7 +75,7 @@ idestart(struct buf *b)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno >= FSSIZE + SWAPSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -120,7 +120,7 @@ ideintr(void)
 
   // Wake process waiting for this buf.
   b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
+  bclean(b);
   wakeup(b);
 
   // Start disk on next buf in queue.
@@ -18,17 +18,21 @@ main(void)
   }
   dup(0);  // stdout
   dup(0);  // stderr
+  mknod("kmsg", 2, 0);  // kernel log; fails harmlessly if present
+  mkdir("proc");        // process statistics; likewise
+  mknod("proc/procs", 3, 0);
+  mknod("proc/cpus", 3, 1);
+  mknod("proc/boot", 3, 2);
+  mknod("proc/swap", 3, 3);
+  mknod("proc/ksm", 3, 4);
+  mknod("proc/bcache", 3, 5);
+  mknod("proc/locks", 3, 6);
 
   for(;;){
     printf(1, "init: starting sh\n");
-    pid = fork();
+    pid = spawn("sh", argv, 0, 0);
     if(pid < 0){
-      printf(1, "init: fork failed\n");
-      exit();
-    }
-    if(pid == 0){
-      exec("sh", argv);
-      printf(1, "init: exec sh failed\n");
+      printf(1, "init: spawn sh failed\n");
       exit();
     }
     while((wpid=wait()) >= 0 && wpid != pid)
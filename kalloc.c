@@ -1,6 +1,29 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Each page has a reference count so that one physical page can be
+// mapped by several page tables (e.g., shared memory, see shm.c).
+// kalloc() returns a page with count 1, kincref() adds a reference,
+// and kfree() drops one, returning the page to the free list only
+// when the last reference goes away.
+//
+// Idle CPUs move free pages to a pool of pre-zeroed pages (see
+// kprezero() and scheduler()), and kalloc_zeroed() takes from that
+// pool, so page tables and user memory are usually not zeroed
+// while a process waits for them.
+//
+// zeropage is a page of zeros that allocuvm() maps copy-on-write
+// in place of new user memory, so that memory a process allocates
+// but does not write takes none.  It is not part of the free
+// memory, and kfree() and kincref() ignore it.  Each mapping of it
+// is a promise of a page later, and kcommit() refuses to make more
+// promises than free memory and free swap could keep at the time,
+// so sbrk() fails once memory is plainly exhausted.  This is only
+// a heuristic against overcommit, not a reservation: kernel
+// allocations, growstack() and ksmd's copy-on-write breaks take
+// pages from the same free memory without a promise, so a write
+// to a promised page can still fail and kill the process.
 
 #include "types.h"
 #include "defs.h"
@@ -8,6 +31,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -21,13 +45,22 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct run *zerolist;        // free pages that are all zero but next
+  int nzero;                   // pages in zerolist
+  int nfree;                   // pages in freelist and zerolist
+  int ncommit;                 // zero-page mappings; see kcommit()
+  ushort ref[PHYSTOP/PGSIZE];  // references to each physical page
 } kmem;
 
+char zeropage[PGSIZE] __attribute__((aligned(PGSIZE)));
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
-// after installing a full page table that maps them on all cores.
+// before starting the other cores, and each core, once it has
+// installed a full page table that maps them, frees its share of
+// them with kinit2cpu().
 void
 kinit1(void *vstart, void *vend)
 {
@@ -36,42 +69,104 @@ kinit1(void *vstart, void *vend)
   freerange(vstart, vend);
 }
 
+static struct {
+  char *start;
+  uint npage;
+} krest;         // the pages given to kinit2()
+
 void
 kinit2(void *vstart, void *vend)
 {
-  freerange(vstart, vend);
+  krest.start = (char*)PGROUNDUP((uint)vstart);
+  krest.npage = ((char*)vend - krest.start) / PGSIZE;
   kmem.use_lock = 1;
 }
 
+// Free this CPU's share of the pages given to kinit2().
+// The pages are linked into a list without the lock, so that
+// the CPUs work in parallel, and the list is put on the free
+// list all at once.
+void
+kinit2cpu(void)
+{
+  struct run *r, *head, **tail;
+  char *p, *e;
+  int i, n;
+
+  i = cpuid();
+  p = krest.start + krest.npage * i / ncpu * PGSIZE;
+  e = krest.start + krest.npage * (i+1) / ncpu * PGSIZE;
+  head = 0;
+  tail = &head;
+  n = 0;
+  for(; p < e; p += PGSIZE, n++){
+#ifdef KALLOC_JUNK
+    memset(p, 1, PGSIZE);
+#endif
+    r = (struct run*)p;
+    *tail = r;
+    tail = &r->next;
+  }
+  if(head == 0)
+    return;
+  acquire(&kmem.lock);
+  *tail = kmem.freelist;
+  kmem.freelist = head;
+  kmem.nfree += n;
+  release(&kmem.lock);
+}
+
 void
 freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.ref[V2P(p)/PGSIZE] = 1;
     kfree(p);
+  }
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
+// Drop a reference to the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when its last reference is dropped.
 void
 kfree(char *v)
 {
   struct run *r;
+  ushort *ref;
 
+  if(v == zeropage)
+    return;
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  ref = &kmem.ref[V2P(v)/PGSIZE];
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(*ref < 1)
+    panic("kfree: ref");
+  if(--*ref > 0){
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
+#ifdef KALLOC_JUNK
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   if(kmem.use_lock)
     release(&kmem.lock);
 }
@@ -79,18 +174,159 @@ kfree(char *v)
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// When memory runs out, the caches and the merged pages nobody
+// maps give pages back, each only if the ones before it had
+// nothing, and as a last resort a user page is paged out to swap.
 char*
 kalloc(void)
 {
   struct run *r;
 
+  for(;;){
+    if(kmem.use_lock)
+      acquire(&kmem.lock);
+    if((r = kmem.freelist) != 0)
+      kmem.freelist = r->next;
+    else if((r = kmem.zerolist) != 0){
+      kmem.zerolist = r->next;
+      kmem.nzero--;
+    }
+    if(r){
+      kmem.ref[V2P(r)/PGSIZE] = 1;
+      kmem.nfree--;
+    }
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    if(r || !kmem.use_lock)
+      return (char*)r;
+    if(!(vmreclaim() || textreclaim() || breclaim() || ksmreclaim() ||
+         swapout()))
+      return 0;
+  }
+}
+
+// Allocate one zero-filled page, from the pre-zeroed pool
+// if it has one.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.nfree--;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(r){
+    r->next = 0;
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
   return (char*)r;
 }
 
+// Zero one free page and move it to the pre-zeroed pool,
+// unless the pool is full.  Called by idle CPUs.
+// Returns 1 if it zeroed a page.
+int
+kprezero(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock || kmem.nzero >= NZEROPG)
+    return 0;
+  acquire(&kmem.lock);
+  if((r = kmem.freelist) != 0){
+    kmem.freelist = r->next;
+    kmem.nfree--;
+  }
+  release(&kmem.lock);
+  if(r == 0)
+    return 0;
+
+  // The page is off both lists, so nobody else can see it.
+  memset(r, 0, PGSIZE);
+
+  acquire(&kmem.lock);
+  r->next = kmem.zerolist;
+  kmem.zerolist = r;
+  kmem.nzero++;
+  kmem.nfree++;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Promise n pages to zero-page mappings, if free memory and swap
+// can hold them now, after the caches give back what they can.
+// Nothing is set aside for the promise (see above).
+// Returns -1 if not.
+int
+kcommit(int n)
+{
+  uint nslot, nused, npagein, npageout;
+  int ok;
+
+  for(;;){
+    swapstat(&nslot, &nused, &npagein, &npageout);
+    acquire(&kmem.lock);
+    ok = kmem.ncommit + n <= kmem.nfree + (int)(nslot - nused);
+    if(ok)
+      kmem.ncommit += n;
+    release(&kmem.lock);
+    if(ok)
+      return 0;
+    if(!(vmreclaim() || textreclaim() || breclaim() || ksmreclaim()))
+      return -1;
+  }
+}
+
+// Take back the promise of n pages: the zero-page mappings
+// were written to, or unmapped.
+void
+kuncommit(int n)
+{
+  acquire(&kmem.lock);
+  kmem.ncommit -= n;
+  if(kmem.ncommit < 0)
+    panic("kuncommit");
+  release(&kmem.lock);
+}
+
+// Return the number of free pages.
+int
+kfreecount(void)
+{
+  return kmem.nfree;
+}
+
+// Add a reference to the allocated page v.
+void
+kincref(char *v)
+{
+  if(v == zeropage)
+    return;
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kincref");
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kincref: free page");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+
+// Return the number of references to the allocated page v.
+int
+kref(char *v)
+{
+  return kmem.ref[V2P(v)/PGSIZE];
+}
@@ -0,0 +1,231 @@
+// Kernel log.
+//
+// cprintf() formats into a ring belonging to the CPU it runs on, with
+// interrupts off, and publishes each message whole by advancing the
+// ring's write index; it takes no lock and never waits for the
+// console.  klogdrain(), run from the timer interrupt on every CPU,
+// copies published messages to the console and to a history buffer
+// that the kmsg device reads.  Only one CPU drains at a time; the
+// others skip the drain rather than wait.  A CPU whose ring is full
+// drops messages and counts them.  panic() and cprintf() before the
+// console is set up flush synchronously with klogflush().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+
+struct klogbuf {
+  char buf[KLOGBUF];
+  volatile uint r;   // next byte to drain; written by the drainer
+  volatile uint w;   // end of published messages; written by this CPU
+  uint pw;           // end of the message being written
+  uint lost;         // bytes dropped; written by this CPU
+  uint lostseen;     // lost bytes reported; written by the drainer
+};
+
+static struct klogbuf klogcpu[NCPU];
+static volatile uint draining;  // a CPU is in klogdrain()
+
+// Messages already drained, for the kmsg device.
+static struct {
+  struct spinlock lock;
+  char buf[KMSGSIZE];
+  uint n;            // bytes ever added; buf holds the last KMSGSIZE
+} hist;
+
+// Before mpinit() there is one CPU, interrupts are off, and
+// pushcli() and acquire() cannot identify the CPU yet.
+static int
+early(void)
+{
+  return ncpu == 0;
+}
+
+void
+kloginit(void)
+{
+  initlock(&hist.lock, "kmsg");
+  devsw[KMSG].read = kmsgread;
+  devsw[KMSG].write = kmsgwrite;
+}
+
+// Start a message on this CPU's ring.  Interrupts stay off
+// until klogend(), so the message cannot be interleaved.
+struct klogbuf*
+klogbegin(void)
+{
+  struct klogbuf *kb;
+
+  if(early())
+    kb = &klogcpu[0];
+  else {
+    pushcli();
+    kb = &klogcpu[cpuid()];
+  }
+  kb->pw = kb->w;
+  return kb;
+}
+
+void
+klogputc(struct klogbuf *kb, int c)
+{
+  if(kb->pw - kb->r >= KLOGBUF){
+    kb->lost++;
+    return;
+  }
+  kb->buf[kb->pw++ % KLOGBUF] = c;
+}
+
+// Publish the message to the drainer.
+void
+klogend(struct klogbuf *kb)
+{
+  __sync_synchronize();
+  kb->w = kb->pw;
+  if(!early())
+    popcli();
+}
+
+static void
+histadd(char *s, int n)
+{
+  int i;
+
+  if(!early())
+    acquire(&hist.lock);
+  for(i = 0; i < n; i++)
+    hist.buf[hist.n++ % KMSGSIZE] = s[i];
+  if(!early())
+    release(&hist.lock);
+}
+
+// Format a note that n bytes were dropped; return its length.
+static int
+lostmsg(char *buf, uint n)
+{
+  char num[10];
+  int i, len;
+
+  i = 0;
+  do{
+    num[i++] = '0' + n % 10;
+  }while((n /= 10) != 0);
+  memmove(buf, "klog: ", 6);
+  len = 6;
+  while(i > 0)
+    buf[len++] = num[--i];
+  memmove(buf + len, " bytes lost\n", 12);
+  return len + 12;
+}
+
+// Print what every CPU has published.
+static void
+drain(void)
+{
+  struct klogbuf *kb;
+  char chunk[64], msg[40];
+  uint w;
+  int n;
+
+  for(kb = klogcpu; kb < &klogcpu[NCPU]; kb++){
+    w = kb->w;
+    __sync_synchronize();
+    while(kb->r != w){
+      for(n = 0; n < sizeof(chunk) && kb->r + n != w; n++)
+        chunk[n] = kb->buf[(kb->r + n) % KLOGBUF];
+      __sync_synchronize();
+      kb->r += n;
+      conslog(chunk, n);
+      histadd(chunk, n);
+    }
+    if(kb->lost != kb->lostseen){
+      n = lostmsg(msg, kb->lost - kb->lostseen);
+      kb->lostseen = kb->lost;
+      conslog(msg, n);
+      histadd(msg, n);
+    }
+  }
+}
+
+void
+klogdrain(void)
+{
+  if(xchg(&draining, 1) != 0)
+    return;
+  drain();
+  xchg(&draining, 0);
+}
+
+// Print everything now, even if another CPU is draining:
+// it may be frozen by a panic.
+void
+klogflush(void)
+{
+  if(early()){
+    drain();
+    return;
+  }
+  pushcli();
+  drain();
+  popcli();
+}
+
+//PAGEBREAK!
+// The kmsg device reads the history.  The offset counts from
+// the oldest byte still held, so a reader racing new messages
+// may see a few bytes twice or miss some.
+int
+kmsgread(struct inode *ip, char *dst, uint off, int n)
+{
+  char buf[128];
+  uint start;
+  int i, m, tot;
+
+  for(tot = 0; tot < n; tot += m, off += m, dst += m){
+    acquire(&hist.lock);
+    start = hist.n > KMSGSIZE ? hist.n - KMSGSIZE : 0;
+    m = n - tot;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    if(off >= hist.n - start)
+      m = 0;
+    else if(m > hist.n - start - off)
+      m = hist.n - start - off;
+    for(i = 0; i < m; i++)
+      buf[i] = hist.buf[(start + off + i) % KMSGSIZE];
+    release(&hist.lock);
+    if(m == 0)
+      break;
+    // Copy outside the lock: dst may be a user page that faults.
+    memmove(dst, buf, m);
+  }
+  return tot;
+}
+
+// Writing to the kmsg device adds a message to the log.
+int
+kmsgwrite(struct inode *ip, char *src, int n)
+{
+  struct klogbuf *kb;
+  char buf[128];
+  int i, m, tot;
+
+  for(tot = 0; tot < n; tot += m){
+    m = n - tot;
+    if(m > sizeof(buf))
+      m = sizeof(buf);
+    memmove(buf, src + tot, m);
+    kb = klogbegin();
+    for(i = 0; i < m; i++)
+      klogputc(kb, buf[i]);
+    klogend(kb);
+  }
+  return n;
+}
@@ -0,0 +1,251 @@
+// Kernel same-page merging.
+//
+// The ksmd kernel thread walks the user memory of all processes,
+// rate pages a clock tick, and hashes each private page it finds.
+// A table indexed by the hash remembers either a candidate, the
+// last page seen with that hash, or a stable page, which ksmd holds
+// a reference to and has mapped copy-on-write in place of identical
+// pages.  When a page matches a stable page byte for byte, its
+// mapping is switched to the stable page and it is freed; when it
+// matches a candidate, the candidate becomes the stable page first.
+// A write to a merged page faults, and cowfault() gives the writer
+// its own copy again.
+//
+// /proc/ksm shows the rate and how many pages are shared and saved;
+// writing a number to it sets the rate, at most KSMMAXRATE, and 0
+// stops ksmd.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct ksment {
+  uint hash;
+  char *page;                  // stable page, or 0
+  int slot, pid;               // candidate: where it was seen,
+  uint va, pa;                 // pid 0 if none
+};
+
+struct {
+  struct spinlock lock;
+  struct ksment e[NKSM];
+  uint rate;                   // pages scanned a tick
+  uint nscan;                  // pages scanned
+  int slot;                    // where the scan is
+  uint va;
+} ksm;
+
+static uint
+hash(char *mem)
+{
+  uint *w, h;
+
+  h = 0;
+  for(w = (uint*)mem; w < (uint*)(mem + PGSIZE); w++)
+    h = h*31 + *w;
+  return h;
+}
+
+// Whether the page at va in p, mapped by pte, is private and
+// writable.  A process asleep in a system call may be about to
+// write the buffer argptr() checked while holding a spinlock,
+// when it cannot take a copy-on-write fault, so skip that.
+static int
+mergeable(struct proc *p, uint va, pte_t *pte)
+{
+  if(va >= p->bufva && va < p->bufend)
+    return 0;
+  return pte && (*pte & (PTE_P|PTE_W|PTE_U|PTE_SHARED|PTE_COW)) ==
+    (PTE_P|PTE_W|PTE_U) && kref(P2V(PTE_ADDR(*pte))) == 1;
+}
+
+// Map the stable page in place of the page at pte and free that.
+static void
+merge(pte_t *pte, char *page)
+{
+  char *old;
+
+  old = P2V(PTE_ADDR(*pte));
+  *pte = V2P(page) | (PTE_FLAGS(*pte) & ~PTE_W) | PTE_COW;
+  kincref(page);
+  kfree(old);
+}
+
+// Make the candidate in e the stable page, if it is still
+// mapped where it was seen and has not changed.
+static int
+promote(struct ksment *e)
+{
+  struct proc *p;
+  pte_t *pte;
+
+  if((p = pinproc(e->slot)) == 0)
+    return 0;
+  pte = 0;
+  if(p->pid == e->pid && e->va < p->sz)
+    pte = walkpgdir(p->pgdir, (char*)e->va, 0);
+  if(!mergeable(p, e->va, pte) || PTE_ADDR(*pte) != e->pa ||
+     hash(P2V(e->pa)) != e->hash){
+    unpinproc();
+    return 0;
+  }
+  *pte = (*pte & ~PTE_W) | PTE_COW;
+  kincref(P2V(e->pa));
+  e->page = P2V(e->pa);
+  e->pid = 0;
+  unpinproc();
+  return 1;
+}
+
+// Look at the page under the scan, and move the scan on.
+// Caller holds ksm.lock.
+static void
+scan(void)
+{
+  struct ksment *e;
+  struct proc *p;
+  pte_t *pte;
+  char *mem;
+  uint h, va;
+  int slot, pid;
+
+  slot = ksm.slot;
+  va = ksm.va;
+  if((p = pinproc(slot)) == 0 || va >= p->sz){
+    if(p)
+      unpinproc();
+    ksm.slot = (slot + 1) % NPROC;
+    ksm.va = 0;
+    return;
+  }
+  ksm.va += PGSIZE;
+  ksm.nscan++;
+  pte = walkpgdir(p->pgdir, (char*)va, 0);
+  if(!mergeable(p, va, pte)){
+    unpinproc();
+    return;
+  }
+  pid = p->pid;
+  mem = P2V(PTE_ADDR(*pte));
+  h = hash(mem);
+  e = &ksm.e[h % NKSM];
+  if(e->page && kref(e->page) == 1){
+    // Nobody maps the stable page any more.
+    kfree(e->page);
+    e->page = 0;
+  }
+  if(e->page){
+    if(e->hash == h && memcmp(e->page, mem, PGSIZE) == 0)
+      merge(pte, e->page);
+    unpinproc();
+    return;
+  }
+  if(e->pid == 0 || e->hash != h || (e->slot == slot && e->va == va)){
+    e->hash = h;
+    e->slot = slot;
+    e->pid = pid;
+    e->va = va;
+    e->pa = PTE_ADDR(*pte);
+    unpinproc();
+    return;
+  }
+
+  // A second page with the candidate's hash.
+  unpinproc();
+  if(!promote(e))
+    return;
+  if((p = pinproc(slot)) == 0)
+    return;
+  if(p->pid == pid && va < p->sz){
+    pte = walkpgdir(p->pgdir, (char*)va, 0);
+    if(mergeable(p, va, pte) && memcmp(e->page, P2V(PTE_ADDR(*pte)), PGSIZE) == 0)
+      merge(pte, e->page);
+  }
+  unpinproc();
+}
+
+static void
+ksmd(void *arg)
+{
+  uint i;
+
+  for(;;){
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
+    // Let go of the lock, and so turn interrupts back on,
+    // between pages.
+    for(i = 0;; i++){
+      acquire(&ksm.lock);
+      if(i >= ksm.rate){
+        release(&ksm.lock);
+        break;
+      }
+      scan();
+      release(&ksm.lock);
+    }
+  }
+}
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+  ksm.rate = KSMRATE;
+  if(kthread_create("ksmd", ksmd, 0) == 0)
+    panic("ksminit");
+}
+
+void
+ksmsetrate(uint rate)
+{
+  if(rate > KSMMAXRATE)
+    rate = KSMMAXRATE;
+  acquire(&ksm.lock);
+  ksm.rate = rate;
+  release(&ksm.lock);
+}
+
+// Free the stable pages that nobody maps any more, for kalloc()
+// to try before swapping.  Returns the number freed.
+int
+ksmreclaim(void)
+{
+  struct ksment *e;
+  int n;
+
+  n = 0;
+  acquire(&ksm.lock);
+  for(e = ksm.e; e < &ksm.e[NKSM]; e++)
+    if(e->page && kref(e->page) == 1){
+      kfree(e->page);
+      e->page = 0;
+      n++;
+    }
+  release(&ksm.lock);
+  return n;
+}
+
+// Report the rate, the pages scanned, the stable pages and the
+// pages saved by mapping them more than once, for /proc/ksm.
+void
+ksmstat(uint *rate, uint *nscan, uint *nshared, uint *nsaved)
+{
+  struct ksment *e;
+  int n;
+
+  acquire(&ksm.lock);
+  *rate = ksm.rate;
+  *nscan = ksm.nscan;
+  *nshared = *nsaved = 0;
+  for(e = ksm.e; e < &ksm.e[NKSM]; e++)
+    if(e->page && (n = kref(e->page)) > 1){
+      (*nshared)++;
+      *nsaved += n - 2;
+    }
+  release(&ksm.lock);
+}
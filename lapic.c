@@ -26,6 +26,7 @@
   #define DEASSERT   0x00000000
   #define LEVEL      0x00008000   // Level triggered
   #define BCAST      0x00080000   // Send to all APICs, including self.
+  #define OTHERS     0x000C0000   // Send to all APICs, excluding self.
   #define BUSY       0x00001000
   #define FIXED      0x00000000
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
@@ -123,10 +124,12 @@ microdelay(int us)
 #define CMOS_PORT    0x70
 #define CMOS_RETURN  0x71
 
-// Start additional processor running entry code at addr.
+// Start all the other processors running entry code at addr.
+// They are sent the startup sequence together, by broadcast,
+// and come up in parallel; see startothers() in main.c.
 // See Appendix B of MultiProcessor Specification.
 void
-lapicstartap(uchar apicid, uint addr)
+lapicstartaps(uint addr)
 {
   int i;
   ushort *wrv;
@@ -141,11 +144,11 @@ lapicstartap(uchar apicid, uint addr)
   wrv[1] = addr >> 4;
 
   // "Universal startup algorithm."
-  // Send INIT (level-triggered) interrupt to reset other CPU.
-  lapicw(ICRHI, apicid<<24);
-  lapicw(ICRLO, INIT | LEVEL | ASSERT);
+  // Send INIT (level-triggered) interrupt to reset the other CPUs.
+  lapicw(ICRHI, 0);
+  lapicw(ICRLO, OTHERS | INIT | LEVEL | ASSERT);
   microdelay(200);
-  lapicw(ICRLO, INIT | LEVEL);
+  lapicw(ICRLO, OTHERS | INIT | LEVEL);
   microdelay(100);    // should be 10ms, but too slow in Bochs!
 
   // Send startup IPI (twice!) to enter code.
@@ -154,8 +157,7 @@ lapicstartap(uchar apicid, uint addr)
   // should be ignored, but it is part of the official Intel algorithm.
   // Bochs complains about the second one.  Too bad for Bochs.
   for(i = 0; i < 2; i++){
-    lapicw(ICRHI, apicid<<24);
-    lapicw(ICRLO, STARTUP | (addr>>12));
+    lapicw(ICRLO, OTHERS | STARTUP | (addr>>12));
     microdelay(200);
   }
 }
@@ -5,6 +5,8 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "mmu.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -20,6 +22,14 @@
 // But if it thinks the log is close to running out, it
 // sleeps until the last outstanding end_op() commits.
 //
+// end_op() commits only when the log is close to running out, or
+// when log_flush() asks it to.  Otherwise the transaction stays
+// open and absorbs the writes of later system calls, and the
+// writeback kernel thread commits it once it is WBTICKS old or
+// holds WBDIRTY blocks.  So a system call returns before its
+// writes are on disk; sync() and fsync() call log_flush() to
+// wait for them.
+//
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
@@ -43,6 +53,9 @@ struct log {
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int flushing;    // log_flush() waits for outstanding ops to end
+  uint ncommit;    // commits done
+  uint since;      // ticks when the transaction got its first block
   int dev;
   struct logheader lh;
 };
@@ -50,6 +63,8 @@ struct log log;
 
 static void recover_from_log(void);
 static void commit();
+static void endcommit(void);
+static void writeback(void*);
 
 void
 initlog(int dev)
@@ -64,6 +79,8 @@ initlog(int dev)
   log.size = sb.nlog;   // 感觉 logheader 已经确定了 log 的标准大小
   log.dev = dev;
   recover_from_log();
+  if(kthread_create("writeback", writeback, 0) == 0)
+    panic("initlog: writeback");
 }
 
 // Copy committed blocks from log to their home location
@@ -129,7 +146,7 @@ begin_op(void)  // begin_lock 确实只是做了 log.outstading++的操作
 {
   acquire(&log.lock);   // 这里并发安全通过自旋锁来获得，注意是并发安全，而没什么并发效率的优化
   while(1){
-    if(log.committing){
+    if(log.committing || log.flushing){
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
@@ -153,7 +170,8 @@ end_op(void)
   log.outstanding -= 1;
   if(log.committing)
     panic("log.committing");
-  if(log.outstanding == 0){
+  if(log.outstanding == 0 &&
+     (log.flushing || log.lh.n + MAXOPBLOCKS > LOGSIZE)){
     do_commit = 1;
     log.committing = 1;
   } else {
@@ -164,14 +182,70 @@ end_op(void)
   }
   release(&log.lock);
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
+  if(do_commit)
+    endcommit();
+}
+
+// Commit the transaction, after setting log.committing.
+static void
+endcommit(void)
+{
+  // call commit w/o holding locks, since not allowed
+  // to sleep with locks.
+  commit();
+  acquire(&log.lock);
+  log.committing = 0;
+  log.flushing = 0;
+  log.ncommit++;
+  wakeup(&log);
+  release(&log.lock);
+}
+
+// Commit the writes of the FS system calls that have ended,
+// and those still in progress, and wait until they are on disk.
+void
+log_flush(void)
+{
+  uint n;
+
+  acquire(&log.lock);
+  if(!log.committing && log.lh.n == 0){
+    release(&log.lock);
+    return;
+  }
+  n = log.ncommit + 1;
+  if(!log.committing){
+    if(log.outstanding == 0){
+      log.committing = 1;
+      release(&log.lock);
+      endcommit();
+      return;
+    }
+    log.flushing = 1;  // the last end_op() commits
+  }
+  while(log.ncommit < n)
+    sleep(&log, &log.lock);
+  release(&log.lock);
+}
+
+// The writeback thread.  Each tick it commits the open
+// transaction if it is old or big enough.
+static void
+writeback(void *arg)
+{
+  int n;
+
+  for(;;){
+    acquire(&tickslock);
+    sleep(&ticks, &tickslock);
+    release(&tickslock);
     acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
+    n = log.lh.n;
+    if(n > 0 && n < WBDIRTY && ticks - log.since < WBTICKS)
+      n = 0;
     release(&log.lock);
+    if(n > 0)
+      log_flush();
   }
 }
 
@@ -230,8 +304,11 @@ log_write(struct buf *b)
       break;
   }
   log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
+  if (i == log.lh.n){
+    if(log.lh.n == 0)
+      log.since = ticks;
     log.lh.n++;
+  }
   b->flags |= B_DIRTY; // prevent eviction
   release(&log.lock);
 }
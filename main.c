@@ -11,29 +11,73 @@ static void mpmain(void)  __attribute__((noreturn));
 extern pde_t *kpgdir;
 extern char end[]; // first address after kernel loaded from ELF file
 
+// The end of each boot phase, by the TSC, which counts from reset.
+// /proc/boot reports them.
+static struct {
+  char *name;
+  uint64 tsc;
+} phases[NBOOTPHASE];
+static int nphase;
+
+static void
+phase(char *name)
+{
+  if(nphase < NBOOTPHASE){
+    phases[nphase].name = name;
+    phases[nphase].tsc = rdtsc();
+    nphase++;
+  }
+}
+
+// Return the name of boot phase i and the TSC at its start and
+// end, or 0 past the last phase.
+char*
+bootphase(int i, uint64 *start, uint64 *end)
+{
+  if(i < 0 || i >= nphase)
+    return 0;
+  *start = i > 0 ? phases[i-1].tsc : 0;
+  *end = phases[i].tsc;
+  return phases[i].name;
+}
+
 // Bootstrap processor starts running C code here.
 // Allocate a real stack and switch to it, first
 // doing some setup required for memory allocator to work.
 int
 main(void)
 {
+  phase("firmware, boot loader");
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
   kvmalloc();      // kernel page table
+  phase("kinit1, kvmalloc");
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
+  phase("cpus, interrupts");
   consoleinit();   // console hardware
   uartinit();      // serial port
+  kloginit();      // kernel log
+  procfsinit();    // process statistics device
   pinit();         // process table
+  shminit();       // shared memory
+  textinit();      // shared program text
   tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
+  phase("devices, tables");
   ideinit();       // disk 
+  swapinit();      // swap space
+  phase("disk");
+  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // the rest, freed by all CPUs
   startothers();   // start other processors
-  kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  phase("other cpus, kinit2");
   userinit();      // first user process
+  aioinit();       // async I/O worker threads
+  ksminit();       // same-page merging thread
+  phase("first process");
   mpmain();        // finish this processor's setup
 }
 
@@ -44,6 +88,7 @@ mpenter(void)
   switchkvm();
   seginit();
   lapicinit();
+  kinit2cpu();     // this CPU's share of kinit2's pages
   mpmain();
 }
 
@@ -59,14 +104,14 @@ mpmain(void)
 
 pde_t entrypgdir[];  // For entry.S
 
-// Start the non-boot (AP) processors.
+// Start the non-boot (AP) processors, all at once.
 static void
 startothers(void)
 {
   extern uchar _binary_entryother_start[], _binary_entryother_size[];
+  static char *stacks[256];  // by APIC ID, for entryother.S
   uchar *code;
   struct cpu *c;
-  char *stack;
 
   // Write entry code to unused memory at 0x7000.
   // The linker has placed the image of entryother.S in
@@ -74,24 +119,25 @@ startothers(void)
   code = P2V(0x7000);
   memmove(code, _binary_entryother_start, (uint)_binary_entryother_size);
 
-  for(c = cpus; c < cpus+ncpu; c++){
-    if(c == mycpu())  // We've started already.
-      continue;
+  // Tell entryother.S where to find each AP's stack, where to enter,
+  // and what pgdir to use. We cannot use kpgdir yet, because the AP
+  // processors are running in low memory, so we use entrypgdir for
+  // the APs too. An AP that has no stack stops.
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != mycpu())  // We've started already.
+      stacks[c->apicid] = kalloc() + KSTACKSIZE;
+  *(char***)(code-4) = stacks;
+  *(void(**)(void))(code-8) = mpenter;
+  *(int**)(code-12) = (void *) V2P(entrypgdir);
 
-    // Tell entryother.S what stack to use, where to enter, and what
-    // pgdir to use. We cannot use kpgdir yet, because the AP processor
-    // is running in low  memory, so we use entrypgdir for the APs too.
-    stack = kalloc();
-    *(void**)(code-4) = stack + KSTACKSIZE;
-    *(void(**)(void))(code-8) = mpenter;
-    *(int**)(code-12) = (void *) V2P(entrypgdir);
+  lapicstartaps(V2P(code));
 
-    lapicstartap(c->apicid, V2P(code));
-
-    // wait for cpu to finish mpmain()
-    while(c->started == 0)
+  // Free our share of memory while the APs come up,
+  // then wait for them to finish mpmain().
+  kinit2cpu();
+  for(c = cpus; c < cpus+ncpu; c++)
+    while(c != mycpu() && c->started == 0)
       ;
-  }
 }
 
 // The boot page table used in entry.S and entryother.S.
@@ -0,0 +1,92 @@
+// multicall() benchmark.
+// Times getpid() and open+fstat+close, the per-entry pattern of ls,
+// made one system call at a time and then in multicall() batches,
+// and prints the ticks each run took.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "multicall.h"
+
+#define N      20000
+#define BATCH  60        // multiple of 3
+
+struct mcall mc[BATCH];
+
+void
+getpidrun(void)
+{
+  int i, n, b;
+  uint t;
+
+  t = uptime();
+  for(i = 0; i < N; i++)
+    getpid();
+  printf(1, "getpid:            %d calls in %d ticks\n", N, uptime() - t);
+
+  for(b = 1; b <= BATCH; b *= 4){
+    for(i = 0; i < b; i++)
+      mc[i].num = SYS_getpid;
+    t = uptime();
+    for(n = 0; n < N; n += b)
+      if(multicall(mc, b, 0) != b){
+        printf(1, "mcbench: multicall failed\n");
+        exit();
+      }
+    printf(1, "getpid batch %d: %s%d calls in %d ticks\n",
+           b, b < 10 ? " " : "", n, uptime() - t);
+  }
+}
+
+void
+statrun(char *path)
+{
+  struct stat st;
+  int i, n, fd;
+  uint t;
+
+  t = uptime();
+  for(i = 0; i < N/3; i++){
+    fd = open(path, O_RDONLY);
+    fstat(fd, &st);
+    close(fd);
+  }
+  printf(1, "open+fstat+close:  %d calls in %d ticks\n",
+         3*(N/3), uptime() - t);
+
+  // open() returns the lowest free fd, so the batch can
+  // name it before it exists.
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf(1, "mcbench: open %s failed\n", path);
+    exit();
+  }
+  close(fd);
+  for(i = 0; i < BATCH; i += 3){
+    mc[i].num = SYS_open;
+    mc[i].args[0] = (int)path;
+    mc[i].args[1] = O_RDONLY;
+    mc[i+1].num = SYS_fstat;
+    mc[i+1].args[0] = fd;
+    mc[i+1].args[1] = (int)&st;
+    mc[i+2].num = SYS_close;
+    mc[i+2].args[0] = fd;
+  }
+  t = uptime();
+  for(n = 0; n < N; n += BATCH)
+    if(multicall(mc, BATCH, MC_STOPERR) != BATCH){
+      printf(1, "mcbench: batched open failed\n");
+      exit();
+    }
+  printf(1, "batched %d:        %d calls in %d ticks\n",
+         BATCH, n, uptime() - t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  getpidrun();
+  statrun(argc > 1 ? argv[1] : "README");
+  exit();
+}
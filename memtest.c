@@ -0,0 +1,204 @@
+// Tests of paging under memory pressure and of same-page merging.
+// They fill most of memory and wait for ksmd, so they are a
+// program of their own rather than part of usertests, which is
+// also near the largest file the file system holds.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define PGSIZE 4096
+#define NKSMPG 8     // pages the ksm test merges
+
+// Read the numbers on the second line of /proc/name, after its
+// heading, into v[0..n-1].  Returns -1 if it cannot.
+int
+procnums(char *name, uint *v, int n)
+{
+  char buf[128], *s;
+  int fd, m, r, i;
+
+  if((fd = open(name, O_RDONLY)) < 0)
+    return -1;
+  m = 0;
+  while(m < sizeof(buf)-1 && (r = read(fd, buf+m, sizeof(buf)-1-m)) > 0)
+    m += r;
+  close(fd);
+  buf[m] = 0;
+  if((s = strchr(buf, '\n')) == 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    while(*s == ' ' || *s == '\n')
+      s++;
+    if(*s < '0' || *s > '9')
+      return -1;
+    v[i] = atoi(s);
+    while(*s >= '0' && *s <= '9')
+      s++;
+  }
+  return 0;
+}
+
+// Check that page i of the n at a starts with i and ends with ~i.
+int
+checkpages(char *a, int n, char *who)
+{
+  int i;
+
+  for(i = 0; i < n; i++){
+    if(*(int*)(a + i*PGSIZE) != i || *(int*)(a + i*PGSIZE + PGSIZE-4) != ~i){
+      printf(1, "swap test: %s lost page %d\n", who, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Grow to half of what sbrk() will give and write every page,
+// so that fork() has to push pages of both copies out to swap
+// to make the child, and copy some the parent has out already.
+// Then both read every page back.
+void
+swaptest(void)
+{
+  uint before[4], after[4];
+  char *a;
+  int n, i, step, pid, ppid;
+
+  printf(1, "swap test\n");
+  if(procnums("/proc/swap", before, 4) < 0 || before[0] == 0){
+    printf(1, "no swap space; swap test skipped\n");
+    return;
+  }
+  a = sbrk(0);
+  n = 0;
+  for(step = 256; step > 0; step /= 16)
+    while(sbrk(step*PGSIZE) != (char*)-1)
+      n += step;
+  sbrk(-n*PGSIZE);
+  n = n/2 - 64;  // leave room for page tables and the like
+  if(n <= 0 || sbrk(n*PGSIZE) != a){
+    printf(1, "swap test: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    *(int*)(a + i*PGSIZE) = i;
+    *(int*)(a + i*PGSIZE + PGSIZE-4) = ~i;
+  }
+
+  ppid = getpid();
+  pid = fork();
+  if(pid < 0){
+    printf(1, "swap test: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(checkpages(a, n, "child") < 0)
+      kill(ppid);
+    exit();
+  }
+  wait();
+  if(checkpages(a, n, "parent") < 0)
+    exit();
+  sbrk(-n*PGSIZE);
+
+  if(procnums("/proc/swap", after, 4) < 0 ||
+     after[3] == before[3] || after[2] == before[2]){
+    printf(1, "swap test: no pages went out and came back\n");
+    exit();
+  }
+  printf(1, "swap test ok: %d pages, %d out, %d in\n",
+         n, after[3] - before[3], after[2] - before[2]);
+}
+
+// Fill page i of the n at a with c+i.  Returns -1 if they were
+// not all full of old+i before.
+int
+fillpages(char *a, int n, int old, int c)
+{
+  int i, j, ok;
+
+  ok = 0;
+  for(i = 0; i < n; i++){
+    for(j = 0; j < PGSIZE; j++)
+      if(a[i*PGSIZE + j] != old + i)
+        ok = -1;
+    memset(a + i*PGSIZE, c + i, PGSIZE);
+  }
+  return ok;
+}
+
+// A forked child's copies of its parent's pages are the same
+// as the parent's, so ksmd merges them.  Each then writes its
+// own, and must see only that.
+void
+ksmtest(void)
+{
+  uint before[4], v[4];
+  char *a, c;
+  int i, pid, p[2];
+
+  printf(1, "ksm test\n");
+  if(procnums("/proc/ksm", before, 4) < 0 || before[0] == 0){
+    printf(1, "ksmd stopped; ksm test skipped\n");
+    return;
+  }
+  a = sbrk(NKSMPG*PGSIZE);
+  if(a == (char*)-1 || pipe(p) < 0){
+    printf(1, "ksm test: sbrk or pipe failed\n");
+    exit();
+  }
+  fillpages(a, NKSMPG, 0, 'A');
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "ksm test: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(p[1]);
+    if(read(p[0], &c, 1) != 1 ||
+       fillpages(a, NKSMPG, 'A', 'a') < 0 || fillpages(a, NKSMPG, 'a', 'a') < 0)
+      printf(1, "ksm test: child sees wrong data\n");
+    exit();
+  }
+  close(p[0]);
+
+  // Give ksmd ten seconds to merge them.
+  for(i = 0; i < 100; i++){
+    sleep(10);
+    if(procnums("/proc/ksm", v, 4) == 0 && v[2] >= before[2] + NKSMPG)
+      break;
+  }
+  if(i == 100){
+    printf(1, "ksm test: pages not merged\n");
+    kill(pid);
+    wait();
+    exit();
+  }
+
+  write(p[1], "x", 1);
+  close(p[1]);
+  if(fillpages(a, NKSMPG, 'A', 'P') < 0){
+    printf(1, "ksm test: parent sees wrong data\n");
+    exit();
+  }
+  wait();
+  if(fillpages(a, NKSMPG, 'P', 'P') < 0){
+    printf(1, "ksm test: child's writes seen by parent\n");
+    exit();
+  }
+  sbrk(-NKSMPG*PGSIZE);
+  printf(1, "ksm test ok\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf(1, "memtest starting\n");
+  swaptest();
+  ksmtest();
+  printf(1, "memtest ok\n");
+  exit();
+}
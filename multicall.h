@@ -0,0 +1,8 @@
+// One call in a multicall() batch.
+struct mcall {
+  int num;       // SYS_ number
+  int args[4];   // arguments, as the call would find them on the stack
+  int ret;       // result, filled in by the kernel
+};
+
+#define MC_STOPERR  0x1  // stop after the first call that returns -1
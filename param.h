@@ -7,8 +7,34 @@
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
+#define NSPAWNACT    16  // max file actions in a spawn()
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define WBTICKS     100  // ticks before writeback commits the log
+#define WBDIRTY      (LOGSIZE/2)  // log blocks that make writeback commit now
+#define NSLSHARED     4  // sleeping locks a process may hold shared at once
+#define SLSPIN     1000  // times a sleeplock waiter spins before sleeping
+#define NBUF         (MAXOPBLOCKS*3)  // disk block cache buffers always there
+#define NBGHOST     128  // blocks the block cache remembers after evicting
+#define BCACHEFREE  256  // free pages below which the block cache stops growing
+#define FSSIZE       2000  // size of file system in blocks
+#define NSWAPPG      1024  // pages of swap space, after the file system
+#define NZEROPG      64  // pre-zeroed pages kept by idle CPUs
+#define NVMCACHE      4  // kernel stacks and page directories cached per CPU
+#define NTEXT        16  // program segments in the shared text cache
+#define USTACKSIZE (64*4096)  // most a user stack may grow to
+#define NKSM        256  // pages remembered by ksmd
+#define KSMRATE      32  // pages ksmd scans a tick, at boot
+#define KSMMAXRATE 1024  // most pages ksmd may be set to scan a tick
+#define NBOOTPHASE   16  // boot phases timed by main()
+#define KLOGBUF    4096  // per-CPU kernel log ring
+#define KMSGSIZE  16384  // kernel log history kept for the kmsg device
+#define NPOLLQ        8  // processes polling one file at once
+#define NSHM         16  // maximum number of shared-memory segments
+#define NSHMPG       64  // maximum pages in a shared-memory segment
+#define NSHMPROC      4  // shared-memory segments attached per process
+#define NAIOCTX       8  // processes with async I/O rings
+#define NAIOPG       33  // pages in an async I/O area, rings included
+#define NAIOREQ      64  // async I/O requests queued or in progress
+#define NAIOTHREAD    4  // async I/O worker threads
 
@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
 
 #define PIPESIZE 512
 
@@ -17,6 +18,7 @@ struct pipe {
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct pollq pollq;  // processes in poll() on either end
 };
 
 int
@@ -34,6 +36,7 @@ pipealloc(struct file **f0, struct file **f1)
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  memset(&p->pollq, 0, sizeof(p->pollq));
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -67,6 +70,7 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  pollwakeup(&p->pollq);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
     kfree((char*)p);
@@ -75,8 +79,10 @@ pipeclose(struct pipe *p, int writable)
 }
 
 //PAGEBREAK: 40
+// If nonblock is set, write what fits without sleeping, and
+// return -1 if nothing does.
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, char *addr, int n, int nonblock)
 {
   int i;
 
@@ -87,24 +93,35 @@ pipewrite(struct pipe *p, char *addr, int n)
         release(&p->lock);
         return -1;
       }
+      if(nonblock){
+        if(i > 0)
+          goto out;
+        release(&p->lock);
+        return -1;
+      }
       wakeup(&p->nread);
+      pollwakeup(&p->pollq);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
     p->data[p->nwrite++ % PIPESIZE] = addr[i];
   }
+out:
   wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  pollwakeup(&p->pollq);
   release(&p->lock);
-  return n;
+  return i;
 }
 
+// If nonblock is set, return -1 instead of sleeping on
+// an empty pipe whose write end is still open.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, char *addr, int n, int nonblock)
 {
   int i;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
-    if(myproc()->killed){
+    if(myproc()->killed || nonblock){
       release(&p->lock);
       return -1;
     }
@@ -116,6 +133,37 @@ piperead(struct pipe *p, char *addr, int n)
     addr[i] = p->data[p->nread++ % PIPESIZE];
   }
   wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  pollwakeup(&p->pollq);
   release(&p->lock);
   return i;
 }
+
+// Return the POLL* events ready on the read end of p,
+// or on the write end if writable is set.
+int
+pipepoll(struct pipe *p, int writable)
+{
+  int r;
+
+  r = 0;
+  acquire(&p->lock);
+  if(writable){
+    if(p->readopen == 0)
+      r = POLLERR;
+    else if(p->nwrite < p->nread + PIPESIZE)
+      r = POLLOUT;
+  } else {
+    if(p->nread != p->nwrite)
+      r = POLLIN;
+    if(p->writeopen == 0)
+      r |= POLLHUP;
+  }
+  release(&p->lock);
+  return r;
+}
+
+struct pollq*
+pipepollq(struct pipe *p)
+{
+  return &p->pollq;
+}
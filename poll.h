@@ -0,0 +1,12 @@
+// poll() request and result for one file descriptor.
+struct pollfd {
+  int fd;
+  short events;   // Events to wait for
+  short revents;  // Events that occurred
+};
+
+#define POLLIN    0x001  // Data to read (or end of file)
+#define POLLOUT   0x004  // Writing will not block
+#define POLLERR   0x008  // Write end with no reader
+#define POLLHUP   0x010  // Read end with no writer
+#define POLLNVAL  0x020  // fd is not open
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "spawn.h"
 
 struct {
   struct spinlock lock;
@@ -88,11 +89,18 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->kthread = 0;
+  memset(&p->acct, 0, sizeof(p->acct));
+  memset(&p->cacct, 0, sizeof(p->cacct));
+  p->nsyscall = 0;
+  p->ustack = 0;
+  p->insyscall = 0;
+  p->bufva = p->bufend = 0;
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
-  if((p->kstack = kalloc()) == 0){
+  if((p->kstack = kstackalloc()) == 0){
     p->state = UNUSED;
     return 0;
   }
@@ -153,6 +161,60 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// First code run by a kernel thread: still holding ptable.lock
+// from scheduler, like forkret.
+static void
+kthreadret(void (*fn)(void*), void *arg)
+{
+  release(&ptable.lock);
+  fn(arg);
+  panic("kthread returned");
+}
+
+// Create a kernel thread that runs fn(arg) in the kernel forever.
+// It has a page table with only the kernel mappings, no parent,
+// no open files and no current directory.  Kernel threads are
+// not started before userinit(), so the file system may only be
+// used in response to requests from user processes, or by the
+// writeback thread, which initlog() starts.
+struct proc*
+kthread_create(char *name, void (*fn)(void*), void *arg)
+{
+  struct proc *p;
+  char *sp;
+
+  if((p = allocproc()) == 0)
+    return 0;
+  if((p->pgdir = setupkvm()) == 0){
+    kstackfree(p->kstack);
+    p->kstack = 0;
+    p->state = UNUSED;
+    return 0;
+  }
+  p->kthread = 1;
+
+  // Replace allocproc's return to trapret with a call
+  // kthreadret(fn, arg) from a fake return address.
+  sp = (char*)p->tf;
+  sp -= 4;
+  *(uint*)sp = (uint)arg;
+  sp -= 4;
+  *(uint*)sp = (uint)fn;
+  sp -= 4;
+  *(uint*)sp = 0;
+  sp -= sizeof *p->context;
+  p->context = (struct context*)sp;
+  memset(p->context, 0, sizeof *p->context);
+  p->context->eip = (uint)kthreadret;
+
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+  return p;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -168,12 +230,31 @@ growproc(int n)
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
+    shmtrim(curproc, sz);
   }
   curproc->sz = sz;
   switchuvm(curproc);
   return 0;
 }
 
+// Give the current process a new page table of size sz and
+// return the old one.  The switch happens under ptable.lock,
+// so procstat() never walks a table that exec() is freeing.
+pde_t*
+setuvm(pde_t *pgdir, uint sz)
+{
+  struct proc *curproc = myproc();
+  pde_t *old;
+
+  acquire(&ptable.lock);
+  old = curproc->pgdir;
+  curproc->pgdir = pgdir;
+  curproc->sz = sz;
+  release(&ptable.lock);
+  switchuvm(curproc);
+  return old;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -191,12 +272,14 @@ fork(void)
 
   // Copy process state from proc.
   if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
+    kstackfree(np->kstack);
     np->kstack = 0;
     np->state = UNUSED;
     return -1;
   }
   np->sz = curproc->sz;
+  np->ustack = curproc->ustack;
+  shmfork(np, curproc);
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -221,6 +304,103 @@ fork(void)
   return pid;
 }
 
+// Apply spawn() file actions to the open files in ofile.
+static int
+spawnfiles(struct file **ofile, struct spawnact *act, int nact)
+{
+  struct file *f;
+  int i;
+
+  for(i = 0; i < nact; i++, act++){
+    if(act->op != SPAWN_OPEN && (act->fd < 0 || act->fd >= NOFILE))
+      return -1;
+    if(act->op != SPAWN_CLOSE && (act->newfd < 0 || act->newfd >= NOFILE))
+      return -1;
+    switch(act->op){
+    case SPAWN_CLOSE:
+      if(ofile[act->fd])
+        fileclose(ofile[act->fd]);
+      ofile[act->fd] = 0;
+      continue;
+    case SPAWN_DUP2:
+      if((f = ofile[act->fd]) == 0)
+        return -1;
+      filedup(f);
+      break;
+    case SPAWN_OPEN:
+      if((f = filealloc()) == 0)
+        return -1;
+      if(fileopen(f, act->path, act->mode) < 0){
+        fileclose(f);
+        return -1;
+      }
+      break;
+    default:
+      return -1;
+    }
+    if(ofile[act->newfd])
+      fileclose(ofile[act->newfd]);
+    ofile[act->newfd] = f;
+  }
+  return 0;
+}
+
+// Create a child of the current process that runs the user image
+// in pgdir, starting at eip with stack pointer esp, and inherits
+// the parent's open files as changed by act.
+// Returns its pid, or -1 with pgdir left to the caller.
+int
+spawnproc(pde_t *pgdir, uint sz, uint eip, uint esp, char *name,
+          struct spawnact *act, int nact)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  for(i = 0; i < NOFILE; i++)
+    if(curproc->ofile[i])
+      np->ofile[i] = filedup(curproc->ofile[i]);
+  if(spawnfiles(np->ofile, act, nact) < 0){
+    for(i = 0; i < NOFILE; i++)
+      if(np->ofile[i]){
+        fileclose(np->ofile[i]);
+        np->ofile[i] = 0;
+      }
+    kstackfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
+  np->cwd = idup(curproc->cwd);
+
+  np->pgdir = pgdir;
+  np->sz = sz;
+  np->ustack = sz - USTACKSIZE;  // as exec() sets it
+  np->parent = curproc;
+  memset(np->tf, 0, sizeof(*np->tf));
+  np->tf->cs = (SEG_UCODE << 3) | DPL_USER;
+  np->tf->ds = (SEG_UDATA << 3) | DPL_USER;
+  np->tf->es = np->tf->ds;
+  np->tf->ss = np->tf->ds;
+  np->tf->eflags = FL_IF;
+  np->tf->esp = esp;
+  np->tf->eip = eip;
+  safestrcpy(np->name, name, sizeof(np->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  np->state = RUNNABLE;
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -234,6 +414,9 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  // Finish async I/O, which may hold files open.
+  aiorelease(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -247,6 +430,8 @@ exit(void)
   end_op();
   curproc->cwd = 0;
 
+  shmrelease(curproc);
+
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
@@ -267,8 +452,22 @@ exit(void)
   panic("zombie exit");
 }
 
+static void
+acctadd(struct pacct *d, struct pacct *s)
+{
+  d->utime += s->utime;
+  d->stime += s->stime;
+  d->nvcsw += s->nvcsw;
+  d->nivcsw += s->nivcsw;
+  d->nfault += s->nfault;
+  d->nstack += s->nstack;
+  d->inblock += s->inblock;
+  d->oublock += s->oublock;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Its resource use, and its children's, is added to ours.
 int
 wait(void)
 {
@@ -287,7 +486,9 @@ wait(void)
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
+        acctadd(&curproc->cacct, &p->acct);
+        acctadd(&curproc->cacct, &p->cacct);
+        kstackfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
         p->pid = 0;
@@ -324,6 +525,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -331,17 +533,21 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
+      c->nswtch++;
       switchuvm(p);
       p->state = RUNNING;
+      p->tsc = rdtsc();
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
@@ -352,6 +558,9 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Nothing to run: zero a page for kalloc_zeroed().
+    if(!ran)
+      kprezero();
   }
 }
 
@@ -376,6 +585,11 @@ sched(void)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  if(p->state == RUNNABLE)
+    p->acct.nivcsw++;
+  else if(p->state == SLEEPING)
+    p->acct.nvcsw++;
+  p->acct.stime += rdtsc() - p->tsc;
   intena = mycpu()->intena;
   swtch(&p->context, mycpu()->scheduler);
   mycpu()->intena = intena;
@@ -484,6 +698,8 @@ kill(int pid)
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
+      if(p->kthread)
+        break;
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
@@ -532,3 +748,119 @@ procdump(void)
     cprintf("\n");
   }
 }
+
+// Choose a user page to page out, by the clock algorithm, and
+// replace its PTE with swapent.  Returns the page, which the caller
+// now owns, or 0 if there is none to take; see swap.c.
+char*
+swapvictim(pte_t swapent)
+{
+  static int hand;      // process and address the clock points at
+  static uint handva;
+  struct proc *p, *curproc;
+  pte_t *pte;
+  char *mem;
+  int n;
+
+  curproc = myproc();
+  acquire(&ptable.lock);
+  // Twice round: the first pass may only clear accessed bits.
+  for(n = 0; n <= 2*NPROC; n++, hand = (hand + 1) % NPROC, handva = 0){
+    p = &ptable.proc[hand];
+    if(p != curproc && (p->state != RUNNABLE || p->insyscall))
+      continue;
+    for(; handva < p->sz; handva += PGSIZE){
+      if((pte = walkpgdir(p->pgdir, (char*)handva, 0)) == 0){
+        handva = PGADDR(PDX(handva) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      if((*pte & (PTE_P|PTE_W|PTE_U|PTE_SHARED|PTE_COW)) !=
+         (PTE_P|PTE_W|PTE_U) || kref(P2V(PTE_ADDR(*pte))) != 1)
+        continue;
+      // The current system call's buffer stays in (see argptr()).
+      if(p == curproc && handva >= p->bufva && handva < p->bufend)
+        continue;
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        if(p == curproc)
+          invlpg((char*)handva);
+        continue;
+      }
+      mem = P2V(PTE_ADDR(*pte));
+      *pte = swapent;
+      if(p == curproc)
+        invlpg((char*)handva);
+      handva += PGSIZE;
+      release(&ptable.lock);
+      return mem;
+    }
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Lock the process table and return the process in slot i, if it
+// is a user process whose memory holds still while the lock is
+// held: one asleep, or one preempted in user space, as a process
+// preempted in the kernel may be in the middle of copying a page.
+// One asleep in a system call may still write the buffer that
+// argptr() checked, which ksm.c leaves alone.
+// Else return 0 with the table unlocked.  Used by ksm.c.
+struct proc*
+pinproc(int i)
+{
+  struct proc *p;
+
+  p = &ptable.proc[i];
+  acquire(&ptable.lock);
+  if(!p->kthread && p->pgdir &&
+     (p->state == SLEEPING || (p->state == RUNNABLE && !p->insyscall)))
+    return p;
+  release(&ptable.lock);
+  return 0;
+}
+
+void
+unpinproc(void)
+{
+  release(&ptable.lock);
+}
+
+// Copy what /proc shows of the process in slot i to *ps.
+// Returns 0 if the slot is unused.
+int
+procstat(int i, struct pstat *ps)
+{
+  struct proc *p;
+  int fd;
+
+  if(i < 0 || i >= NPROC)
+    return 0;
+  p = &ptable.proc[i];
+  acquire(&ptable.lock);
+  if(p->state == UNUSED){
+    release(&ptable.lock);
+    return 0;
+  }
+  ps->pid = p->pid;
+  ps->ppid = p->parent ? p->parent->pid : 0;
+  ps->state = p->state;
+  safestrcpy(ps->name, p->name, sizeof(ps->name));
+  ps->utime = div64(tsc2us(p->acct.utime), 1000);
+  ps->stime = div64(tsc2us(p->acct.stime), 1000);
+  ps->nvcsw = p->acct.nvcsw;
+  ps->nivcsw = p->acct.nivcsw;
+  ps->nfault = p->acct.nfault;
+  ps->nsyscall = p->nsyscall;
+  // An embryo's page table may not be built yet, and
+  // wait() frees a zombie's.
+  ps->rss = 0;
+  if(p->state != EMBRYO && p->state != ZOMBIE && p->pgdir)
+    ps->rss = uvmresident(p->pgdir, p->sz);
+  ps->nfd = 0;
+  for(fd = 0; fd < NOFILE; fd++)
+    if(p->ofile[fd])
+      ps->nfd++;
+  release(&ptable.lock);
+  return 1;
+}
@@ -8,6 +8,10 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  uint nintr;                  // Device interrupts taken
+  uint idle;                   // Clock ticks with no process running
+  uint busy;                   // Clock ticks with a process running
+  uint nswtch;                 // Switches to a process
 };
 
 extern struct cpu cpus[NCPU];
@@ -32,6 +36,24 @@ struct context {
   uint eip;
 };
 
+// A shared-memory segment attached to a process (see shm.c).
+struct shmmap {
+  int id;                      // Segment id + 1, or 0 if slot is free
+  uint va;                     // Where the segment is mapped
+};
+
+// Resources used by a process.  Times are TSC cycles.
+struct pacct {
+  uint64 utime;                // In user space
+  uint64 stime;                // In the kernel
+  uint nvcsw;                  // Times it gave up the CPU to wait
+  uint nivcsw;                 // Times it was preempted
+  uint nfault;                 // Page faults
+  uint nstack;                 // Stack pages added on faults
+  uint inblock;                // Blocks read from disk
+  uint oublock;                // Blocks written to disk
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -49,6 +71,32 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct shmmap shm[NSHMPROC]; // Attached shared-memory segments
+  int pollev;                  // poll(): a polled file may be ready
+  int kthread;                 // Kernel thread; never runs in user space
+  struct aioctx *aio;          // Async I/O rings, if set up
+  struct pacct acct;           // Resources used
+  struct pacct cacct;          // Used by children it has waited for
+  uint64 tsc;                  // When acct was last charged
+  uint nsyscall;               // System calls made
+  uint ustack;                 // Lowest address the stack may grow to
+  int insyscall;               // In a system call, so pages stay in
+  uint bufva, bufend;          // Pages of the buffer argptr() checked
+  struct sleeplock *shared[NSLSHARED]; // Sleeping locks held shared
+};
+
+// What /proc shows of a process; see procstat().
+struct pstat {
+  int pid;
+  int ppid;
+  enum procstate state;
+  char name[16];
+  uint utime, stime;           // Milliseconds
+  uint nvcsw, nivcsw;
+  uint nfault;
+  uint nsyscall;
+  uint rss;                    // Resident user pages
+  int nfd;                     // Open files
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -56,3 +104,4 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   (shared-memory segments are mapped at the top of the heap)
@@ -0,0 +1,308 @@
+// Process and CPU statistics, read as text.
+//
+// The PROCFS device formats a table when it is read, selected by
+// the minor number: init makes /proc/procs (minor 0), with a line
+// per process, /proc/cpus (minor 1), with a line per CPU, and
+// /proc/boot (minor 2), with a line per boot phase, /proc/swap
+// (minor 3), with the swap slots in use and the pages moved, and
+// /proc/ksm (minor 4), with what ksmd has merged, /proc/bcache
+// (minor 5), with the size and hit rate of the buffer cache, and
+// /proc/locks (minor 6), with the contention on sleeping locks.
+// Writing a number to /proc/ksm sets ksmd's scan rate, in pages a
+// tick.
+// Process times are in milliseconds, CPU times in clock ticks,
+// and boot phases in thousands of TSC cycles.
+// A reader that reads in pieces gets each line as it stands when
+// its piece is read.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "x86.h"
+
+#define PROCS 0
+#define CPUS  1
+#define BOOT  2
+#define SWAP  3
+#define KSM   4
+#define BCACHE 5
+#define LOCKS 6
+
+// A line being formatted.
+struct line {
+  char buf[128];
+  int n;
+};
+
+static void
+putstr(struct line *l, char *s, int width)
+{
+  int n;
+
+  for(n = 0; s[n] && l->n < sizeof(l->buf); n++)
+    l->buf[l->n++] = s[n];
+  for(; n < width && l->n < sizeof(l->buf); n++)
+    l->buf[l->n++] = ' ';
+}
+
+// Right-justify x in width columns after a space.
+static void
+putint(struct line *l, uint x, int width)
+{
+  char num[11];
+  int i;
+
+  i = 0;
+  do{
+    num[i++] = '0' + x % 10;
+  }while((x /= 10) != 0);
+  for(width -= i; width >= 0 && l->n < sizeof(l->buf); width--)
+    l->buf[l->n++] = ' ';
+  while(i > 0 && l->n < sizeof(l->buf))
+    l->buf[l->n++] = num[--i];
+}
+
+static char *states[] = {
+[UNUSED]    "unused",
+[EMBRYO]    "embryo",
+[SLEEPING]  "sleep",
+[RUNNABLE]  "runble",
+[RUNNING]   "run",
+[ZOMBIE]    "zombie"
+};
+
+// Format line i of a table; return 0 past the end.
+// Unused process slots make empty lines, which are skipped.
+static int
+procline(struct line *l, int i)
+{
+  struct pstat ps;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "  pid ppid state   utime  stime    vcsw   ivcsw  faults"
+              "  rss fds syscalls name\n", 0);
+    return 1;
+  }
+  if(i > NPROC)
+    return 0;
+  if(!procstat(i - 1, &ps))
+    return 1;
+  putint(l, ps.pid, 4);
+  putint(l, ps.ppid, 4);
+  putstr(l, " ", 0);
+  putstr(l, states[ps.state], 6);
+  putint(l, ps.utime, 6);
+  putint(l, ps.stime, 6);
+  putint(l, ps.nvcsw, 7);
+  putint(l, ps.nivcsw, 7);
+  putint(l, ps.nfault, 7);
+  putint(l, ps.rss, 4);
+  putint(l, ps.nfd, 3);
+  putint(l, ps.nsyscall, 8);
+  putstr(l, " ", 0);
+  putstr(l, ps.name, 0);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+static int
+cpuline(struct line *l, int i)
+{
+  struct cpu *c;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "cpu apic     intr     idle     busy  switches\n", 0);
+    return 1;
+  }
+  if(i > ncpu)
+    return 0;
+  c = &cpus[i - 1];
+  putint(l, i - 1, 2);
+  putint(l, c->apicid, 4);
+  putint(l, c->nintr, 8);
+  putint(l, c->idle, 8);
+  putint(l, c->busy, 8);
+  putint(l, c->nswtch, 9);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+static int
+bootline(struct line *l, int i)
+{
+  uint64 start, end;
+  char *name;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "phase                   kcycles   end at\n", 0);
+    return 1;
+  }
+  if((name = bootphase(i - 1, &start, &end)) == 0)
+    return 0;
+  putstr(l, name, 22);
+  putint(l, div64(end - start, 1000), 8);
+  putint(l, div64(end, 1000), 8);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+static int
+swapline(struct line *l, int i)
+{
+  uint nslot, nused, npagein, npageout;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "slots  used  pageins pageouts\n", 0);
+    return 1;
+  }
+  if(i > 1)
+    return 0;
+  swapstat(&nslot, &nused, &npagein, &npageout);
+  putint(l, nslot, 4);
+  putint(l, nused, 5);
+  putint(l, npagein, 8);
+  putint(l, npageout, 8);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+static int
+ksmline(struct line *l, int i)
+{
+  uint rate, nscan, nshared, nsaved;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "rate  scanned shared  saved\n", 0);
+    return 1;
+  }
+  if(i > 1)
+    return 0;
+  ksmstat(&rate, &nscan, &nshared, &nsaved);
+  putint(l, rate, 3);
+  putint(l, nscan, 8);
+  putint(l, nshared, 6);
+  putint(l, nsaved, 6);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+static int
+bcacheline(struct line *l, int i)
+{
+  uint nbuf, nhot, nhit, nmiss, nevict;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "bufs  hot     hits   misses   evicts\n", 0);
+    return 1;
+  }
+  if(i > 1)
+    return 0;
+  bstat(&nbuf, &nhot, &nhit, &nmiss, &nevict);
+  putint(l, nbuf, 3);
+  putint(l, nhot, 4);
+  putint(l, nhit, 8);
+  putint(l, nmiss, 8);
+  putint(l, nevict, 8);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+static int
+locksline(struct line *l, int i)
+{
+  uint nacquire, ncontend, nspin, nsleep;
+
+  l->n = 0;
+  if(i == 0){
+    putstr(l, "acquires contended     spun    slept\n", 0);
+    return 1;
+  }
+  if(i > 1)
+    return 0;
+  sleeplockstat(&nacquire, &ncontend, &nspin, &nsleep);
+  putint(l, nacquire, 7);
+  putint(l, ncontend, 9);
+  putint(l, nspin, 8);
+  putint(l, nsleep, 8);
+  putstr(l, "\n", 0);
+  return 1;
+}
+
+int
+procfsread(struct inode *ip, char *dst, uint off, int n)
+{
+  struct line l;
+  uint pos;
+  int i, m, tot, more;
+
+  tot = 0;
+  pos = 0;
+  for(i = 0; tot < n; i++){
+    if(ip->minor == PROCS)
+      more = procline(&l, i);
+    else if(ip->minor == CPUS)
+      more = cpuline(&l, i);
+    else if(ip->minor == BOOT)
+      more = bootline(&l, i);
+    else if(ip->minor == SWAP)
+      more = swapline(&l, i);
+    else if(ip->minor == KSM)
+      more = ksmline(&l, i);
+    else if(ip->minor == BCACHE)
+      more = bcacheline(&l, i);
+    else if(ip->minor == LOCKS)
+      more = locksline(&l, i);
+    else
+      return -1;
+    if(!more)
+      break;
+    if(pos + l.n > off){
+      // The part of the line at or after off, up to n bytes.
+      m = pos + l.n - off;
+      if(m > n - tot)
+        m = n - tot;
+      memmove(dst + tot, l.buf + (off - pos), m);
+      tot += m;
+      off += m;
+    }
+    pos += l.n;
+  }
+  return tot;
+}
+
+// Only /proc/ksm can be written: a number sets the scan rate.
+int
+procfswrite(struct inode *ip, char *src, int n)
+{
+  uint rate;
+  int i;
+
+  if(ip->minor != KSM)
+    return -1;
+  rate = 0;
+  for(i = 0; i < n && src[i] >= '0' && src[i] <= '9'; i++)
+    rate = rate*10 + src[i] - '0';
+  if(i == 0)
+    return -1;
+  ksmsetrate(rate);
+  return n;
+}
+
+void
+procfsinit(void)
+{
+  devsw[PROCFS].read = procfsread;
+  devsw[PROCFS].write = procfswrite;
+}
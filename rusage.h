@@ -0,0 +1,27 @@
+struct timeval {
+  uint sec;
+  uint usec;
+};
+
+// getrusage() result.
+struct rusage {
+  struct timeval utime;  // Time in user space
+  struct timeval stime;  // Time in the kernel
+  uint nvcsw;            // Times it gave up the CPU to wait
+  uint nivcsw;           // Times it was preempted
+  uint nfault;           // Page faults
+  uint nstack;           // Stack pages added on faults
+  uint inblock;          // Blocks read from disk
+  uint oublock;          // Blocks written to disk
+};
+
+#define RUSAGE_SELF      0
+#define RUSAGE_CHILDREN  1  // children that have been waited for
+
+// times() result, in clock ticks.
+struct tms {
+  uint utime;
+  uint stime;
+  uint cutime;   // of children that have been waited for
+  uint cstime;
+};
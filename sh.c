@@ -3,6 +3,8 @@
 #include "types.h"
 #include "user.h"
 #include "fcntl.h"
+#include "rusage.h"
+#include "spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,12 +54,14 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int spawncmd(struct cmd*, struct spawnact*, int);
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
   int p[2];
+  struct spawnact act[3];
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -91,7 +95,7 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
+    if(spawncmd(lcmd->left, 0, 0) < 0 && fork1() == 0)
       runcmd(lcmd->left);
     wait();
     runcmd(lcmd->right);
@@ -101,14 +105,23 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
+    act[0].op = SPAWN_DUP2;
+    act[0].fd = p[1];
+    act[0].newfd = 1;
+    act[1].op = SPAWN_CLOSE;
+    act[1].fd = p[0];
+    act[2].op = SPAWN_CLOSE;
+    act[2].fd = p[1];
+    if(spawncmd(pcmd->left, act, 3) < 0 && fork1() == 0){
       close(1);
       dup(p[1]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
+    act[0].fd = p[0];
+    act[0].newfd = 0;
+    if(spawncmd(pcmd->right, act, 3) < 0 && fork1() == 0){
       close(0);
       dup(p[0]);
       close(p[0]);
@@ -130,6 +143,37 @@ runcmd(struct cmd *cmd)
   exit();
 }
 
+// Start cmd with spawn(), which does not copy the shell, if it
+// is a program run with only redirections.  The redirections
+// follow the file actions in pre.  Returns the pid, or -1 if
+// cmd must be run in a forked shell, which also reports errors.
+int
+spawncmd(struct cmd *cmd, struct spawnact *pre, int npre)
+{
+  struct spawnact act[8];
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int n;
+
+  memmove(act, pre, npre*sizeof(act[0]));
+  for(n = npre; cmd && cmd->type == REDIR; n++){
+    if(n == sizeof(act)/sizeof(act[0]))
+      return -1;
+    rcmd = (struct redircmd*)cmd;
+    act[n].op = SPAWN_OPEN;
+    act[n].newfd = rcmd->fd;
+    act[n].path = rcmd->file;
+    act[n].mode = rcmd->mode;
+    cmd = rcmd->cmd;
+  }
+  if(cmd == 0 || cmd->type != EXEC)
+    return -1;
+  ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0)
+    return -1;
+  return spawn(ecmd->argv[0], ecmd->argv, act, n);
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -141,6 +185,57 @@ getcmd(char *buf, int nbuf)
   return 0;
 }
 
+// Print a time in seconds to the millisecond.
+void
+prtime(char *label, uint us)
+{
+  uint ms = us / 1000;
+
+  printf(2, " %s %d.%s%s%d", label, ms / 1000,
+         ms % 1000 < 100 ? "0" : "", ms % 1000 < 10 ? "0" : "", ms % 1000);
+}
+
+uint
+tvdiff(struct timeval *a, struct timeval *b)
+{
+  return (b->sec - a->sec)*1000000 + b->usec - a->usec;
+}
+
+void freecmd(struct cmd*);
+
+// Run the command line in buf and wait for it.
+void
+runline(char *buf)
+{
+  struct cmd *cmd;
+
+  if((cmd = parsecmd(buf)) == 0)
+    return;
+  if(spawncmd(cmd, 0, 0) < 0 && fork1() == 0)
+    runcmd(cmd);
+  wait();
+  freecmd(cmd);
+}
+
+// Run buf and report the time it took and the
+// CPU time it and its children used.
+void
+timecmd(char *buf)
+{
+  struct rusage r0, r1;
+  uint t;
+
+  getrusage(RUSAGE_CHILDREN, &r0);
+  t = uptime();
+  runline(buf);
+  t = uptime() - t;
+  getrusage(RUSAGE_CHILDREN, &r1);
+  prtime("real", t*10000);
+  prtime("user", tvdiff(&r0.utime, &r1.utime));
+  prtime("sys", tvdiff(&r0.stime, &r1.stime));
+  printf(2, "\n");
+}
+
 int
 main(void)
 {
@@ -164,9 +259,12 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if(buf[0] == 't' && buf[1] == 'i' && buf[2] == 'm' && buf[3] == 'e' &&
+       buf[4] == ' '){
+      timecmd(buf+5);
+      continue;
+    }
+    runline(buf);
   }
   exit();
 }
@@ -256,6 +354,30 @@ backcmd(struct cmd *subcmd)
   cmd->cmd = subcmd;
   return (struct cmd*)cmd;
 }
+
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
 //PAGEBREAK!
 // Parsing
 
@@ -324,6 +446,18 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The shell parses commands itself, so a syntax error must not
+// exit.  The parser notes the first error and carries on.
+char *synerr;
+
+void
+syntax(char *msg)
+{
+  if(synerr == 0)
+    synerr = msg;
+}
+
+// Parse s; return 0 after reporting a syntax error.
 struct cmd*
 parsecmd(char *s)
 {
@@ -335,7 +469,13 @@ parsecmd(char *s)
   peek(&s, es, "");
   if(s != es){
     printf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(synerr){
+    printf(2, "%s\n", synerr);
+    synerr = 0;
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +519,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -406,8 +548,9 @@ parseblock(char **ps, char *es)
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
   if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
-  gettoken(ps, es, 0, 0);
+    syntax("syntax - missing )");
+  else
+    gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
 }
@@ -431,13 +574,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc + 1 >= MAXARGS){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -0,0 +1,252 @@
+// Shared-memory segments.
+//
+// A segment is a set of physical pages named by a user-chosen key.
+// shmget() finds or creates the segment for a key, shmat() maps its
+// pages at the top of the calling process's memory, and shmdt()
+// unmaps them again.  The pages are reference counted by kalloc.c:
+// the segment holds one reference and every page table that maps a
+// page holds another, so freevm() and deallocuvm() release mappings
+// with the ordinary kfree().  Mappings carry PTE_SHARED, which makes
+// fork() share the pages with the child instead of copying them.
+//
+// The segment itself goes away when the last attached process
+// detaches, execs or exits.  Creating a segment counts as an
+// attachment until the creator first attaches it, execs or exits,
+// so a segment nobody ever attaches does not outlive its creator.
+// Key 0 always creates a new segment.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct shmseg {
+  int key;
+  int npages;                  // 0 if this slot is free
+  int nattach;                 // processes that have it attached
+  int creator;                 // pid holding the creation reference
+  char *pages[NSHMPG];
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Drop one attachment of s; free the segment if it was the last.
+// Caller must hold shmtable.lock.
+static void
+shmput(struct shmseg *s)
+{
+  int i;
+
+  if(s->nattach < 1)
+    panic("shmput");
+  if(--s->nattach > 0)
+    return;
+  for(i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  s->npages = 0;
+  s->key = 0;
+}
+
+// Return the id of the segment with the given key, creating a
+// zero-filled segment of size bytes if there is none.
+// Returns -1 on error.
+int
+shmget(int key, int size)
+{
+  struct shmseg *s, *free;
+  int i, n;
+
+  n = PGROUNDUP(size) / PGSIZE;
+  if(size <= 0 || n > NSHMPG)
+    return -1;
+
+  acquire(&shmtable.lock);
+  free = 0;
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+      continue;
+    }
+    if(key != 0 && s->key == key){
+      release(&shmtable.lock);
+      if(n > s->npages)
+        return -1;
+      return s - shmtable.seg;
+    }
+  }
+  if((s = free) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  for(i = 0; i < n; i++){
+    if((s->pages[i] = kalloc_zeroed()) == 0){
+      while(--i >= 0)
+        kfree(s->pages[i]);
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  s->key = key;
+  s->npages = n;
+  s->nattach = 1;
+  s->creator = myproc()->pid;
+  release(&shmtable.lock);
+  return s - shmtable.seg;
+}
+
+// Map segment id at the top of the current process's memory.
+// Returns the address of the mapping, or -1 on error.
+int
+shmat(int id)
+{
+  struct proc *curproc = myproc();
+  struct shmmap *m;
+  struct shmseg *s;
+  uint va;
+  int i;
+
+  if(id < 0 || id >= NSHM)
+    return -1;
+  for(m = curproc->shm; m < &curproc->shm[NSHMPROC]; m++)
+    if(m->id == 0)
+      break;
+  if(m == &curproc->shm[NSHMPROC])
+    return -1;
+
+  s = &shmtable.seg[id];
+  acquire(&shmtable.lock);
+  va = PGROUNDUP(curproc->sz);
+  if(s->npages == 0 || va + s->npages*PGSIZE >= KERNBASE){
+    release(&shmtable.lock);
+    return -1;
+  }
+  for(i = 0; i < s->npages; i++){
+    if(shareuvm(curproc->pgdir, va + i*PGSIZE, V2P(s->pages[i]),
+                PTE_W|PTE_U|PTE_SHARED) < 0){
+      deallocuvm(curproc->pgdir, va + i*PGSIZE, va);
+      release(&shmtable.lock);
+      return -1;
+    }
+  }
+  // The creator's first attachment takes over its reference.
+  if(s->creator == curproc->pid)
+    s->creator = 0;
+  else
+    s->nattach++;
+  release(&shmtable.lock);
+
+  m->id = id + 1;
+  m->va = va;
+  curproc->sz = va + s->npages*PGSIZE;
+  switchuvm(curproc);
+  return va;
+}
+
+// Unmap the segment attached at va.  A segment at the top of memory
+// shrinks the process; one below later growth is replaced by
+// zero-filled private memory so that the address space stays
+// contiguous.  Returns 0 on success, -1 if nothing is attached at va.
+int
+shmdt(uint va)
+{
+  struct proc *curproc = myproc();
+  struct shmmap *m;
+  struct shmseg *s;
+  uint end;
+
+  for(m = curproc->shm; m < &curproc->shm[NSHMPROC]; m++)
+    if(m->id != 0 && m->va == va)
+      break;
+  if(m == &curproc->shm[NSHMPROC])
+    return -1;
+
+  s = &shmtable.seg[m->id - 1];
+  end = va + s->npages*PGSIZE;
+  deallocuvm(curproc->pgdir, end, va);
+  if(end >= curproc->sz)
+    curproc->sz = va;
+  else if(allocuvm(curproc->pgdir, va, end) == 0)
+    curproc->killed = 1;  // out of memory; cannot leave a hole
+
+  acquire(&shmtable.lock);
+  shmput(s);
+  release(&shmtable.lock);
+  m->id = 0;
+  switchuvm(curproc);
+  return 0;
+}
+
+// Give child np the parent's attachments.  The pages themselves
+// are shared by copyuvm() because of PTE_SHARED.
+void
+shmfork(struct proc *np, struct proc *p)
+{
+  int i;
+
+  acquire(&shmtable.lock);
+  for(i = 0; i < NSHMPROC; i++){
+    np->shm[i] = p->shm[i];
+    if(np->shm[i].id)
+      shmtable.seg[np->shm[i].id - 1].nattach++;
+  }
+  release(&shmtable.lock);
+}
+
+// Drop all of p's attachments, and the creation references of
+// segments it made but never attached, as on exit() and exec().
+// The mappings go away with the page table.
+void
+shmrelease(struct proc *p)
+{
+  struct shmseg *s;
+  int i;
+
+  acquire(&shmtable.lock);
+  for(i = 0; i < NSHMPROC; i++){
+    if(p->shm[i].id){
+      shmput(&shmtable.seg[p->shm[i].id - 1]);
+      p->shm[i].id = 0;
+    }
+  }
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages && s->creator == p->pid){
+      s->creator = 0;
+      shmput(s);
+    }
+  }
+  release(&shmtable.lock);
+}
+
+// Forget attachments that p's memory no longer fully covers
+// after shrinking to sz.
+void
+shmtrim(struct proc *p, uint sz)
+{
+  struct shmseg *s;
+  int i;
+
+  acquire(&shmtable.lock);
+  for(i = 0; i < NSHMPROC; i++){
+    if(p->shm[i].id == 0)
+      continue;
+    s = &shmtable.seg[p->shm[i].id - 1];
+    if(p->shm[i].va + s->npages*PGSIZE > sz){
+      shmput(s);
+      p->shm[i].id = 0;
+    }
+  }
+  release(&shmtable.lock);
+}
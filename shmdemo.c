@@ -0,0 +1,126 @@
+// Shared-memory ring buffer demo.
+// A producer and a consumer process move the same amount of data
+// first through a pipe and then through a ring buffer in a
+// shared-memory segment, and print the ticks each run took.
+// The consumer checksums the ring data in place, so the shared
+// run copies nothing through the kernel.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define CHUNK   4096
+#define NCHUNK  2048               // 8 MB in total
+#define RINGSZ  (15*CHUNK)
+
+struct ring {
+  volatile uint head;              // bytes produced
+  volatile uint tail;              // bytes consumed
+  char pad[CHUNK - 2*sizeof(uint)];
+  char data[RINGSZ];
+};
+
+char buf[CHUNK];
+
+#define barrier() asm volatile("" ::: "memory")
+
+static uint
+sum(char *p, int n)
+{
+  uint s;
+
+  s = 0;
+  while(n-- > 0)
+    s += (uchar)*p++;
+  return s;
+}
+
+static void
+fill(char *p, int i)
+{
+  int j;
+
+  for(j = 0; j < CHUNK; j++)
+    p[j] = i + j;
+}
+
+uint
+pipetest(void)
+{
+  int fds[2], i, n, tot;
+  uint s, t0;
+
+  if(pipe(fds) < 0){
+    printf(1, "shmdemo: pipe failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(i = 0; i < NCHUNK; i++){
+      fill(buf, i);
+      write(fds[1], buf, CHUNK);
+    }
+    exit();
+  }
+  close(fds[1]);
+  s = 0;
+  tot = 0;
+  while((n = read(fds[0], buf, sizeof(buf))) > 0){
+    s += sum(buf, n);
+    tot += n;
+  }
+  close(fds[0]);
+  wait();
+  printf(1, "pipe: %d KB in %d ticks (sum %x)\n",
+         tot/1024, uptime() - t0, s);
+  return s;
+}
+
+uint
+shmtest(void)
+{
+  struct ring *r;
+  int id, i;
+  uint s, t0, off;
+
+  if((id = shmget(0, sizeof(*r))) < 0 ||
+     (r = shmat(id)) == (struct ring*)-1){
+    printf(1, "shmdemo: shared memory failed\n");
+    exit();
+  }
+  t0 = uptime();
+  if(fork() == 0){
+    for(i = 0; i < NCHUNK; i++){
+      while(r->head - r->tail > RINGSZ - CHUNK)
+        ;
+      fill(r->data + r->head % RINGSZ, i);
+      barrier();
+      r->head += CHUNK;
+    }
+    exit();
+  }
+  s = 0;
+  for(i = 0; i < NCHUNK; i++){
+    while(r->head == r->tail)
+      ;
+    barrier();
+    off = r->tail % RINGSZ;
+    s += sum(r->data + off, CHUNK);
+    barrier();
+    r->tail += CHUNK;
+  }
+  wait();
+  printf(1, "shm:  %d KB in %d ticks (sum %x)\n",
+         NCHUNK*CHUNK/1024, uptime() - t0, s);
+  shmdt(r);
+  return s;
+}
+
+int
+main(void)
+{
+  if(pipetest() != shmtest())
+    printf(1, "shmdemo: checksums differ\n");
+  exit();
+}
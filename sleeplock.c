@@ -1,4 +1,22 @@
 // Sleeping locks
+//
+// A sleeping lock is held either exclusively, by acquiresleep(),
+// or shared, by any number of acquiresleepshared() callers at once.
+// releasesleep() releases either.  A process waiting to hold the
+// lock exclusively keeps new sharers out, so that a stream of
+// readers cannot starve it.  So a process must not take a lock
+// shared that it already holds shared: if a writer came between,
+// it would wait for itself.  Each process lists the locks it holds
+// shared, in p->shared, which catches this and lets
+// holdingsleepany() check that the caller really is a holder.
+//
+// Locks such as those of buffers are often held only briefly.
+// A process that finds the lock held exclusively by a process
+// running on another CPU spins, up to SLSPIN times, instead of
+// sleeping, since the holder will likely release it before a
+// sleep and wakeup would finish.  Otherwise it sleeps.  /proc/locks
+// shows how many acquires found the lock held, and of those, how
+// many got it by spinning without sleeping, and how many slept.
 
 #include "types.h"
 #include "defs.h"
@@ -10,34 +28,142 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 
+// Counts for /proc/locks, per CPU so that acquires on
+// different CPUs do not share a cache line.
+static struct {
+  uint nacquire, ncontend, nspin, nsleep;
+} __attribute__((aligned(64))) slstat[NCPU];
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->nreader = 0;
+  lk->nwaiting = 0;
+  lk->nsleeping = 0;
+  lk->owner = 0;
   lk->pid = 0;
 }
 
+static int
+busy(struct sleeplock *lk, int shared)
+{
+  return lk->locked || (shared ? lk->nwaiting > 0 : lk->nreader > 0);
+}
+
+// Is lk held by a process running on another CPU?
+// This reads lk and the owner's state without their locks, on
+// purpose: the answer only decides whether to spin a little
+// longer, and a stale one costs at most a wasted spin or an
+// early sleep.  The owner's struct proc is in the static process
+// table, so reading it is safe even if the owner has exited.
+static int
+ownerrunning(struct sleeplock *lk, struct proc *me)
+{
+  struct proc *p = lk->owner;
+
+  return lk->locked && p != 0 && p != me && p->state == RUNNING;
+}
+
+// Wait until lk is free to be held shared, or exclusively.
+// Called and returns with lk->lk held.
+static void
+slwait(struct sleeplock *lk, int shared)
+{
+  struct proc *me = myproc();
+  int i, slept;
+
+  slstat[cpuid()].ncontend++;
+  i = slept = 0;
+  while(busy(lk, shared)){
+    if(i < SLSPIN && ownerrunning(lk, me)){
+      release(&lk->lk);
+      for(; i < SLSPIN && ownerrunning(lk, me); i++)
+        pause();
+      acquire(&lk->lk);
+      continue;
+    }
+    lk->nsleeping++;
+    sleep(lk, &lk->lk);
+    lk->nsleeping--;
+    slept = 1;
+  }
+  if(slept)
+    slstat[cpuid()].nsleep++;
+  else if(i > 0)
+    slstat[cpuid()].nspin++;  // spinning got it
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
-  }
+  slstat[cpuid()].nacquire++;
+  lk->nwaiting++;
+  if(busy(lk, 0))
+    slwait(lk, 0);
+  lk->nwaiting--;
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
 
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  struct sleeplock **s, **free;
+
+  free = 0;
+  for(s = myproc()->shared; s < &myproc()->shared[NSLSHARED]; s++){
+    if(*s == lk)
+      panic("acquiresleepshared: nested");
+    if(*s == 0 && free == 0)
+      free = s;
+  }
+  if(free == 0)
+    panic("acquiresleepshared: too many");
+
+  acquire(&lk->lk);
+  slstat[cpuid()].nacquire++;
+  if(busy(lk, 1))
+    slwait(lk, 1);
+  lk->nreader++;
+  *free = lk;
+  release(&lk->lk);
+}
+
+// Where lk is in this process's list of locks held shared, or 0.
+static struct sleeplock**
+sharedslot(struct sleeplock *lk)
+{
+  struct sleeplock **s;
+
+  for(s = myproc()->shared; s < &myproc()->shared[NSLSHARED]; s++)
+    if(*s == lk)
+      return s;
+  return 0;
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct sleeplock **s;
+
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if(lk->locked){
+    lk->locked = 0;
+    lk->owner = 0;
+    lk->pid = 0;
+  } else if(lk->nreader > 0 && (s = sharedslot(lk)) != 0){
+    lk->nreader--;
+    *s = 0;
+  } else
+    panic("releasesleep");
+  if(lk->nreader == 0 && lk->nsleeping > 0)
+    wakeup(lk);
   release(&lk->lk);
 }
 
@@ -52,5 +178,31 @@ holdingsleep(struct sleeplock *lk)
   return r;
 }
 
+// Is the lock held by this process, exclusively or shared?
+int
+holdingsleepany(struct sleeplock *lk)
+{
+  int r;
+
+  acquire(&lk->lk);
+  r = (lk->locked && lk->pid == myproc()->pid) || sharedslot(lk) != 0;
+  release(&lk->lk);
+  return r;
+}
 
+// Report the acquires, those that found the lock held, and of
+// those, the ones that spun and the ones that slept, for
+// /proc/locks.
+void
+sleeplockstat(uint *nacquire, uint *ncontend, uint *nspin, uint *nsleep)
+{
+  int i;
 
+  *nacquire = *ncontend = *nspin = *nsleep = 0;
+  for(i = 0; i < ncpu; i++){
+    *nacquire += slstat[i].nacquire;
+    *ncontend += slstat[i].ncontend;
+    *nspin += slstat[i].nspin;
+    *nsleep += slstat[i].nsleep;
+  }
+}
@@ -1,10 +1,14 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int nreader;       // Processes holding it shared
+  int nwaiting;      // Processes waiting to hold it exclusively
+  int nsleeping;     // Processes asleep waiting for it
+  struct proc *owner; // Process holding it exclusively
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
-  int pid;           // Process holding lock
+  int pid;           // Process holding lock exclusively
 };
 
@@ -0,0 +1,13 @@
+// A file action for spawn(), applied in order to the child's
+// copy of the parent's open files before it starts.
+struct spawnact {
+  int op;
+  int fd;        // SPAWN_CLOSE: fd to close; SPAWN_DUP2: fd to copy
+  int newfd;     // SPAWN_DUP2, SPAWN_OPEN: fd to set
+  char *path;    // SPAWN_OPEN: file to open
+  int mode;      // SPAWN_OPEN: as for open()
+};
+
+#define SPAWN_CLOSE  1
+#define SPAWN_DUP2   2
+#define SPAWN_OPEN   3
@@ -1,9 +1,25 @@
-// Demonstrate that moving the "acquire" in iderw after the loop that
-// appends to the idequeue results in a race.
-
-// For this to work, you should also add a spin within iderw's
-// idequeue traversal loop.  Adding the following demonstrated a panic
-// after about 5 runs of stressfs in QEMU on a 2.1GHz CPU:
+// File system load generator.
+//
+// stressfs forks nproc processes, each of which fills its own file
+// of kbytes KB and then makes nops reads and writes of bsize bytes
+// at sequential or random block offsets, readpct percent of them
+// reads, with an fsync after every nfsync writes (without -f, the
+// writeback thread commits the writes later).  It reports the
+// throughput of all the processes together and the latency
+// percentiles of reads and writes, timed with the TSC.  The random
+// choices come from seed, so the command line, which stressfs
+// prints first, reproduces a run.  The fill is not measured.
+//
+// Usage: stressfs [-p nproc] [-s kbytes] [-b bsize] [-n nops]
+//                 [-r readpct] [-f nfsync] [-S seed] [-R]
+// -R selects random offsets.
+//
+// Run with no arguments, several processes write and read files at
+// once, which shows that moving the "acquire" in iderw after the
+// loop that appends to the idequeue results in a race.  For this to
+// work, you should also add a spin within iderw's idequeue
+// traversal loop.  Adding the following demonstrated a panic after
+// about 5 runs of stressfs in QEMU on a 2.1GHz CPU:
 //    for (i = 0; i < 40000; i++)
 //      asm volatile("");
 
@@ -12,38 +28,240 @@
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
+#include "x86.h"
 
-int
-main(int argc, char *argv[])
+#define WRITE 0x80000000   // marks a write's latency
+#define MAXBS 8192
+
+// Results, in memory shared with the workers.
+struct result {
+  uint64 start, end;
+  int done;                // ops completed
+};
+
+int nproc = 5, kbytes = 10, bsize = 512, nops = 40;
+int readpct = 50, nfsync = 0, seed = 1, rnd = 0;
+char buf[MAXBS];
+uint tsctick;              // TSC cycles per tick
+
+void
+calibrate(void)
 {
-  int fd, i;
-  char path[] = "stressfs0";
-  char data[512];
+  uint t;
+  uint64 c;
 
-  printf(1, "stressfs starting\n");
-  memset(data, 'a', sizeof(data));
+  t = uptime();
+  while(uptime() == t)
+    ;
+  c = rdtsc();
+  t = uptime();
+  while(uptime() < t + 10)
+    ;
+  tsctick = div64(rdtsc() - c, 10);
+}
 
-  for(i = 0; i < 4; i++)
-    if(fork() > 0)
-      break;
+uint
+rand(uint *s)
+{
+  *s = *s * 1103515245 + 12345;
+  return *s >> 8;
+}
+
+void
+worker(int id, struct result *res, uint *lat)
+{
+  char path[] = "stressfs00";
+  int fd, i, nblk, nw, r;
+  uint s, off;
+  uint64 t;
 
-  printf(1, "write %d\n", i);
+  path[8] += id / 10;
+  path[9] += id % 10;
+  if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+    printf(2, "stressfs: cannot create %s\n", path);
+    exit();
+  }
+  nblk = kbytes*1024 / bsize;
+  for(i = 0; i < nblk; i++)
+    if(write(fd, buf, bsize) != bsize){
+      printf(2, "stressfs: fill %s failed\n", path);
+      exit();
+    }
 
-  path[8] += i;
-  fd = open(path, O_CREATE | O_RDWR);
-  for(i = 0; i < 20; i++)
-//    printf(fd, "%d\n", i);
-    write(fd, data, sizeof(data));
+  s = seed + 7919*id;
+  nw = 0;
+  res->start = rdtsc();
+  for(i = 0; i < nops; i++){
+    off = (rnd ? rand(&s) % nblk : i % nblk) * bsize;
+    t = rdtsc();
+    if(rand(&s) % 100 < readpct){
+      r = pread(fd, buf, bsize, off);
+      lat[i] = 0;
+    } else {
+      r = pwrite(fd, buf, bsize, off);
+      if(nfsync && ++nw % nfsync == 0)
+        fsync(fd);
+      lat[i] = WRITE;
+    }
+    if(r != bsize){
+      printf(2, "stressfs: I/O on %s failed\n", path);
+      break;
+    }
+    lat[i] |= (uint)(rdtsc() - t) & ~WRITE;
+  }
+  res->end = rdtsc();
+  res->done = i;
   close(fd);
+  unlink(path);
+  exit();
+}
 
-  printf(1, "read\n");
+// Shell sort; n may be tens of thousands.
+void
+sort(uint *a, int n)
+{
+  int gap, i, j;
+  uint x;
 
-  fd = open(path, O_RDONLY);
-  for (i = 0; i < 20; i++)
-    read(fd, data, sizeof(data));
-  close(fd);
+  for(gap = 1; gap < n/3; gap = 3*gap + 1)
+    ;
+  for(; gap > 0; gap /= 3)
+    for(i = gap; i < n; i++){
+      x = a[i];
+      for(j = i; j >= gap && a[j-gap] > x; j -= gap)
+        a[j] = a[j-gap];
+      a[j] = x;
+    }
+}
 
-  wait();
+// Print a latency in microseconds with one decimal.
+void
+printus(char *label, uint cyc)
+{
+  uint t = div64((uint64)cyc * 100000, tsctick);
+
+  printf(1, " %s %d.%d", label, t / 10, t % 10);
+}
+
+void
+report(char *name, uint *a, int n)
+{
+  sort(a, n);
+  printf(1, "%s: %d ops, us:", name, n);
+  if(n > 0){
+    printus("p50", a[n/2]);
+    printus("p90", a[n*9/10]);
+    printus("p99", a[n*99/100]);
+    printus("max", a[n-1]);
+  }
+  printf(1, "\n");
+}
+
+int
+getarg(char **argv, int i, int argc)
+{
+  if(i + 1 >= argc){
+    printf(2, "stressfs: %s needs a value\n", argv[i]);
+    exit();
+  }
+  return atoi(argv[i+1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct result *res;
+  uint *lat, *rd, *wr, us;
+  uint64 start, end;
+  int i, id, n, nr, nwr, sz;
+  char *a;
+
+  for(i = 1; i < argc; i++){
+    if(strcmp(argv[i], "-R") == 0){
+      rnd = 1;
+      continue;
+    }
+    n = getarg(argv, i, argc);
+    if(strcmp(argv[i], "-p") == 0)
+      nproc = n;
+    else if(strcmp(argv[i], "-s") == 0)
+      kbytes = n;
+    else if(strcmp(argv[i], "-b") == 0)
+      bsize = n;
+    else if(strcmp(argv[i], "-n") == 0)
+      nops = n;
+    else if(strcmp(argv[i], "-r") == 0)
+      readpct = n;
+    else if(strcmp(argv[i], "-f") == 0)
+      nfsync = n;
+    else if(strcmp(argv[i], "-S") == 0)
+      seed = n;
+    else {
+      printf(2, "usage: stressfs [-p nproc] [-s kbytes] [-b bsize] "
+             "[-n nops] [-r readpct] [-f nfsync] [-S seed] [-R]\n");
+      exit();
+    }
+    i++;
+  }
+  if(nproc < 1 || nproc > 100 || bsize < 1 || bsize > MAXBS ||
+     kbytes*1024 < bsize || nops < 1){
+    printf(2, "stressfs: bad arguments\n");
+    exit();
+  }
+  printf(1, "stressfs -p %d -s %d -b %d -n %d -r %d -f %d -S %d%s\n",
+         nproc, kbytes, bsize, nops, readpct, nfsync, seed, rnd ? " -R" : "");
+
+  sz = nproc*sizeof(struct result) + nproc*nops*sizeof(uint);
+  if((id = shmget(0, sz)) < 0 || (a = shmat(id)) == (char*)-1){
+    printf(2, "stressfs: cannot get %d bytes of shared memory\n", sz);
+    exit();
+  }
+  res = (struct result*)a;
+  lat = (uint*)(res + nproc);
+  calibrate();
+  memset(buf, 'a', sizeof(buf));
+
+  for(i = 0; i < nproc; i++){
+    if((n = fork()) < 0){
+      printf(2, "stressfs: fork failed\n");
+      break;
+    }
+    if(n == 0)
+      worker(i, &res[i], lat + i*nops);
+  }
+  nproc = i;
+  for(i = 0; i < nproc; i++)
+    wait();
 
+  // Split the latencies into reads, in place, and writes.
+  rd = lat;
+  if((wr = malloc(nproc*nops*sizeof(uint))) == 0){
+    printf(2, "stressfs: out of memory\n");
+    exit();
+  }
+  nr = nwr = 0;
+  start = res[0].start;
+  end = res[0].end;
+  for(i = 0; i < nproc; i++){
+    if(res[i].start < start)
+      start = res[i].start;
+    if(res[i].end > end)
+      end = res[i].end;
+    for(n = 0; n < res[i].done; n++){
+      if(lat[i*nops + n] & WRITE)
+        wr[nwr++] = lat[i*nops + n] & ~WRITE;
+      else
+        rd[nr++] = lat[i*nops + n];
+    }
+  }
+  report("read", rd, nr);
+  report("write", wr, nwr);
+  us = div64((end - start) * 10000, tsctick);
+  if(us == 0)
+    us = 1;
+  printf(1, "total: %d ops in %d us, %d ops/s, %d KB/s\n", nr + nwr, us,
+         (uint)div64((uint64)(nr + nwr) * 1000000, us),
+         (uint)div64((uint64)(nr + nwr) * bsize / 1024 * 1000000, us));
+  shmdt(a);
   exit();
 }
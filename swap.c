@@ -0,0 +1,185 @@
+// Swap space.
+//
+// When kalloc() runs out of memory and the other caches have
+// nothing left to give back, swapout() writes a user page to a
+// page-sized slot of the swap area, which mkfs reserves on the disk
+// after the file system, and frees it.  The page's PTE keeps the
+// slot number, with PTE_SWAP set and PTE_P clear, so the next touch
+// of the page faults and swapin() reads it back.
+//
+// Pages are chosen by swapvictim() in proc.c with the clock
+// algorithm, which passes over pages the hardware has marked
+// accessed since its last visit.  Only private, writable user pages
+// are paged out, and only from the calling process or from
+// processes preempted in user space: code that holds a spinlock
+// may use a process's memory, but only a buffer that argptr() has
+// checked, which it first brings back in, during a system call,
+// when no other process takes its pages and swapvictim() skips
+// that buffer in the caller's.
+//
+// swap.lock serializes the disk transfers, and so a swapin() of a
+// page waits for its swapout() to finish.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define SLOTBLKS (PGSIZE/BSIZE)
+
+extern struct superblock sb;
+
+struct {
+  struct sleeplock lock;
+  struct buf buf;              // for the transfers
+  struct spinlock slotlock;    // protects the rest
+  uchar used[NSWAPPG];         // slots in use
+  uint nused;
+  uint npagein, npageout;
+} swap;
+
+void
+swapinit(void)
+{
+  initsleeplock(&swap.lock, "swap");
+  initsleeplock(&swap.buf.lock, "swapbuf");
+  initlock(&swap.slotlock, "swapslot");
+}
+
+static int
+slotalloc(void)
+{
+  int i;
+
+  acquire(&swap.slotlock);
+  for(i = 0; i < NSWAPPG && i < sb.nswap/SLOTBLKS; i++)
+    if(!swap.used[i]){
+      swap.used[i] = 1;
+      swap.nused++;
+      release(&swap.slotlock);
+      return i;
+    }
+  release(&swap.slotlock);
+  return -1;
+}
+
+// Free the slot in a swap PTE, when the page is unmapped.
+void
+swapfree(pte_t pte)
+{
+  uint i;
+
+  i = PTE_ADDR(pte) >> PTXSHIFT;
+  acquire(&swap.slotlock);
+  if(i >= NSWAPPG || !swap.used[i])
+    panic("swapfree");
+  swap.used[i] = 0;
+  swap.nused--;
+  release(&swap.slotlock);
+}
+
+// Read or write the page at mem from or to slot.
+// Caller holds swap.lock.
+static void
+slotrw(int slot, char *mem, int write)
+{
+  struct buf *b = &swap.buf;
+  int i;
+
+  acquiresleep(&b->lock);
+  b->dev = ROOTDEV;
+  for(i = 0; i < SLOTBLKS; i++){
+    b->blockno = sb.swapstart + slot*SLOTBLKS + i;
+    if(write){
+      memmove(b->data, mem + i*BSIZE, BSIZE);
+      b->flags = B_DIRTY;
+    } else
+      b->flags = 0;
+    iderw(b);
+    if(!write)
+      memmove(mem + i*BSIZE, b->data, BSIZE);
+  }
+  releasesleep(&b->lock);
+}
+
+// Page out one user page, if the caller may sleep.
+// Returns 1 if it freed a page.
+int
+swapout(void)
+{
+  struct proc *p;
+  char *mem;
+  int slot, ok;
+
+  pushcli();
+  p = mycpu()->proc;
+  ok = p != 0 && mycpu()->ncli == 1;  // no spinlocks held
+  popcli();
+  if(!ok)
+    return 0;
+
+  acquiresleep(&swap.lock);
+  if((slot = slotalloc()) < 0){
+    releasesleep(&swap.lock);
+    return 0;
+  }
+  if((mem = swapvictim((slot << PTXSHIFT) | PTE_SWAP)) == 0){
+    swapfree((slot << PTXSHIFT) | PTE_SWAP);
+    releasesleep(&swap.lock);
+    return 0;
+  }
+  slotrw(slot, mem, 1);
+  kfree(mem);
+  acquire(&swap.slotlock);
+  swap.npageout++;
+  release(&swap.slotlock);
+  releasesleep(&swap.lock);
+  return 1;
+}
+
+// Read back the page at va in pgdir if it is swapped out.
+// Returns -1 if it is not, or memory ran out.
+int
+swapin(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0 ||
+     !(*pte & PTE_SWAP))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  acquiresleep(&swap.lock);
+  if(*pte & PTE_SWAP){
+    slotrw(PTE_ADDR(*pte) >> PTXSHIFT, mem, 0);
+    swapfree(*pte);
+    *pte = V2P(mem) | PTE_P | PTE_W | PTE_U;
+    mem = 0;
+    acquire(&swap.slotlock);
+    swap.npagein++;
+    release(&swap.slotlock);
+  }
+  releasesleep(&swap.lock);
+  if(mem)
+    kfree(mem);
+  return 0;
+}
+
+// Report slots in use and pages moved, for /proc/swap.
+void
+swapstat(uint *nslot, uint *nused, uint *npagein, uint *npageout)
+{
+  acquire(&swap.slotlock);
+  *nslot = sb.nswap/SLOTBLKS < NSWAPPG ? sb.nswap/SLOTBLKS : NSWAPPG;
+  *nused = swap.nused;
+  *npagein = swap.npagein;
+  *npageout = swap.npageout;
+  release(&swap.slotlock);
+}
@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "multicall.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -54,20 +55,48 @@ argint(int n, int *ip)
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size bytes.  Check that the pointer
 // lies within the process address space.
+// Code that holds a spinlock, such as pipewrite(), may use the
+// block, and cannot take a fault that needs memory then.  So
+// the block is brought in now, and until the system call
+// returns or checks another block, swapvictim() and ksmd
+// leave its pages alone, even if kalloc() runs short first.
 int
 argptr(int n, char **pp, int size)
 {
   int i;
+  uint a;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
   if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
     return -1;
+  curproc->bufva = PGROUNDDOWN(i);
+  curproc->bufend = PGROUNDUP((uint)i + size);
+  for(a = curproc->bufva; a < curproc->bufend; a += PGSIZE)
+    if(uvmtouch(curproc, a, 0) < 0)
+      return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Like argptr(), for a block the system call will write to:
+// break copy-on-write and zero-page mappings now, since
+// piperead() and consoleread() write it holding a spinlock.
+int
+argptrw(int n, char **pp, int size)
+{
+  struct proc *curproc = myproc();
+  uint a;
+
+  if(argptr(n, pp, size) < 0)
+    return -1;
+  for(a = PGROUNDDOWN((uint)*pp); a < (uint)*pp + size; a += PGSIZE)
+    if(uvmtouch(curproc, a, 1) < 0)
+      return -1;
+  return 0;
+}
+
 // 获取第n个word大小的系统调用参数，作为一个string指针。检查指针是否合法以及字符串是否以nul结尾。
 // 没有共享的可写内存，所以字符串在这个检查和内核使用它之间不会改变。（fetchstr并不实际复制字符串，而是用一个指针指向它。）
 int
@@ -100,6 +129,21 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_poll(void);
+extern int sys_pipe2(void);
+extern int sys_aiosetup(void);
+extern int sys_aioenter(void);
+static int sys_multicall(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_fsync(void);
+extern int sys_getrusage(void);
+extern int sys_times(void);
+extern int sys_spawn(void);
+extern int sys_sync(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -123,6 +167,21 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_poll]    sys_poll,
+[SYS_pipe2]   sys_pipe2,
+[SYS_aiosetup] sys_aiosetup,
+[SYS_aioenter] sys_aioenter,
+[SYS_multicall] sys_multicall,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_fsync]   sys_fsync,
+[SYS_getrusage] sys_getrusage,
+[SYS_times]   sys_times,
+[SYS_spawn]   sys_spawn,
+[SYS_sync]    sys_sync,
 };
 
 void
@@ -132,6 +191,7 @@ syscall(void)
   struct proc *curproc = myproc();
 
   num = curproc->tf->eax;
+  curproc->nsyscall++;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     curproc->tf->eax = syscalls[num]();
   } else {
@@ -140,3 +200,46 @@ syscall(void)
     curproc->tf->eax = -1;
   }
 }
+
+//PAGEBREAK!
+// Run a batch of system calls in one trap: multicall(calls, n, flags)
+// runs calls[0..n-1] in order, storing each result in its ret.
+// The calls find their arguments with argint() as usual, through
+// tf->esp pointed just below each call's args.  Calls that replace
+// or duplicate the process's user state cannot be batched.
+// Returns the number of calls run.
+static int
+sys_multicall(void)
+{
+  struct proc *curproc = myproc();
+  struct mcall *c;
+  int n, flags, i, num, ret;
+  uint esp;
+
+  if(argint(1, &n) < 0 || argint(2, &flags) < 0)
+    return -1;
+  if(n < 0 || n > curproc->sz / sizeof(*c) ||
+     argptrw(0, (void*)&c, n*sizeof(*c)) < 0)
+    return -1;
+
+  esp = curproc->tf->esp;
+  for(i = 0; i < n && !curproc->killed; ){
+    num = c[i].num;
+    if(num <= 0 || num >= NELEM(syscalls) || syscalls[num] == 0 ||
+       num == SYS_fork || num == SYS_exit || num == SYS_exec ||
+       num == SYS_multicall){
+      ret = -1;
+    } else {
+      curproc->tf->esp = (uint)c[i].args - 4;
+      ret = syscalls[num]();
+      curproc->tf->esp = esp;
+      // The call may have shrunk memory under the batch.
+      if((uint)c + n*sizeof(*c) > curproc->sz)
+        return i;
+    }
+    c[i++].ret = ret;
+    if(ret == -1 && (flags & MC_STOPERR))
+      break;
+  }
+  return i;
+}
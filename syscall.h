@@ -20,3 +20,18 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_shmget 22
+#define SYS_shmat  23
+#define SYS_shmdt  24
+#define SYS_poll   25
+#define SYS_pipe2  26
+#define SYS_aiosetup 27
+#define SYS_aioenter 28
+#define SYS_multicall 29
+#define SYS_pread  30
+#define SYS_pwrite 31
+#define SYS_fsync  32
+#define SYS_getrusage 33
+#define SYS_times  34
+#define SYS_spawn  35
+#define SYS_sync   36
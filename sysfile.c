@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "poll.h"
+#include "spawn.h"
 
 // 获取第n个word大小的系统调用参数作为文件描述符，文件描述符存入pfd指向的内存中，struct file指针存入pf指向的内存中
 static int
@@ -76,7 +78,7 @@ sys_read(void)
   // argfd(0,0,&f): 获取第0个word大小的系统调用参数作为文件描述符，struct file指针存入f指向的内存中。作为要读的文件。
   // argint(2, &n): 获取第2个32位系统调用参数，存入n中。作为要读的字节数。
   // argptr(1, &p, n): 获取第1个word大小的系统调用参数，存入p指向的内存中，n是p指向的内存的大小。作为读取的数据存放的地址。
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptrw(1, &p, n) < 0)
     return -1;
   // 把文件 *f 读到地址 p 中，从 f_off 位置开始读，n 是读取的字节数
   return fileread(f, p, n);
@@ -95,6 +97,53 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Like read and write, but at offset off, leaving the file offset alone.
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptrw(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Wait until the file's writes are on disk.  All files share
+// one log, so this is the same as sync().
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  log_flush();
+  return 0;
+}
+
+int
+sys_sync(void)
+{
+  log_flush();
+  return 0;
+}
+
 int
 sys_close(void) // 关闭文件：通过第0个系统调用参数，把文件 *f 关闭，释放文件描述符
 {
@@ -115,7 +164,7 @@ sys_fstat(void) // 这里其实终于看出来了，系统调用就是合法性
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argptrw(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -292,16 +341,12 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
+// Open path with mode omode into f, a file fresh from filealloc().
+// Returns 0 on success, -1 on failure.  Also used by aio.c.
 int
-sys_open(void)
+fileopen(struct file *f, char *path, int omode)
 {
-  char *path;
-  int fd, omode;
-  struct file *f;
   struct inode *ip;
-  // 这里的第一个参数是path，第二个参数是omode
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -324,23 +369,43 @@ sys_open(void)
     }
   }
 
-  // f为新建的文件结构体，fd为文件描述符
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){  // file结构或fd至少一个分配失败：
-    if(f)
-      fileclose(f);
-    iunlockput(ip);
-    end_op();
-    return -1;
-  }
   iunlock(ip);
   end_op();
 
   // 前面inode的操作结束了，因为可能释放inode，所以在log中写。这里之后就是内存中的file操作了。
-  f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  f->nonblock = (omode & O_NONBLOCK) != 0;
+  // An aio open fills in f while it is already in the submitting
+  // process's table, so f must be complete before it is usable.
+  __sync_synchronize();
+  f->type = FD_INODE;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  return 0;
+}
+
+int
+sys_open(void)
+{
+  char *path;
+  int fd, omode;
+  struct file *f;
+  // 这里的第一个参数是path，第二个参数是omode
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+
+  // f为新建的文件结构体，fd为文件描述符
+  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){  // file结构或fd至少一个分配失败：
+    if(f)
+      fileclose(f);
+    return -1;
+  }
+  if(fileopen(f, path, omode) < 0){
+    myproc()->ofile[fd] = 0;
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -435,16 +500,50 @@ sys_exec(void)
 }
 
 int
-sys_pipe(void)
+sys_spawn(void)
+{
+  char *path, *s, *argv[MAXARG];
+  struct spawnact *act;
+  int i, nact;
+  uint uargv, uarg;
+
+  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0 ||
+     argint(3, &nact) < 0 || nact < 0 || nact > NSPAWNACT ||
+     argptr(2, (void*)&act, nact*sizeof(*act)) < 0)
+    return -1;
+  memset(argv, 0, sizeof(argv));
+  for(i=0;; i++){
+    if(i >= NELEM(argv))
+      return -1;
+    if(fetchint(uargv+4*i, (int*)&uarg) < 0)
+      return -1;
+    if(uarg == 0){
+      argv[i] = 0;
+      break;
+    }
+    if(fetchstr(uarg, &argv[i]) < 0)
+      return -1;
+  }
+  for(i = 0; i < nact; i++)
+    if(act[i].op == SPAWN_OPEN && fetchstr((uint)act[i].path, &s) < 0)
+      return -1;
+  return spawn(path, argv, act, nact);
+}
+
+static int
+pipefds(int flags)
 {
   int *fd;
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argptrw(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+    return -1;
+  if(flags & ~O_NONBLOCK)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
+  rf->nonblock = wf->nonblock = (flags & O_NONBLOCK) != 0;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
@@ -457,3 +556,110 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+int
+sys_pipe(void)
+{
+  return pipefds(0);
+}
+
+int
+sys_pipe2(void)
+{
+  int flags;
+
+  if(argint(1, &flags) < 0)
+    return -1;
+  return pipefds(flags);
+}
+
+//PAGEBREAK!
+// Wait until one of the files in fds is ready for the events
+// asked for, or timeout ticks pass (-1: forever, 0: just check).
+// Returns the number of fds with non-zero revents.
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  struct pollq *q[NOFILE];
+  struct proc *curproc = myproc();
+  struct file *f;
+  int nfds, timeout, i, n, full;
+  uint t0;
+
+  if(argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(argptrw(0, (void*)&fds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+
+  for(i = 0; i < nfds; i++)
+    q[i] = 0;
+  t0 = ticks;
+  for(;;){
+    // Get on every queue before looking, so that a wakeup
+    // after the check below is not lost.
+    pollbegin();
+    full = 0;
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if(fds[i].fd >= NOFILE || (f = curproc->ofile[fds[i].fd]) == 0){
+        fds[i].revents = POLLNVAL;
+        n++;
+        continue;
+      }
+      if(q[i] == 0 && (q[i] = filepollq(f)) != 0 && pollregister(q[i]) < 0){
+        q[i] = 0;
+        full = 1;
+      }
+      fds[i].revents = filepoll(f) &
+        (fds[i].events | POLLERR | POLLHUP | POLLNVAL);
+      if(fds[i].revents)
+        n++;
+    }
+    if(n > 0 || timeout == 0 || curproc->killed)
+      break;
+    if(timeout > 0 && ticks - t0 >= timeout)
+      break;
+    // A queue with no room cannot wake us, so re-check each tick.
+    if((timeout > 0 || full) && pollregister(&tickpollq) < 0){
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+      continue;
+    }
+    pollsleep();
+  }
+
+  for(i = 0; i < nfds; i++)
+    if(q[i])
+      pollunregister(q[i]);
+  pollunregister(&tickpollq);
+  if(curproc->killed)
+    return -1;
+  return n;
+}
+
+int
+sys_aiosetup(void)
+{
+  int nbuf;
+
+  if(argint(0, &nbuf) < 0)
+    return -1;
+  return aiosetup(nbuf);
+}
+
+int
+sys_aioenter(void)
+{
+  int minwait;
+
+  if(argint(0, &minwait) < 0)
+    return -1;
+  return aioenter(minwait);
+}
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "rusage.h"
 
 int
 sys_fork(void)
@@ -89,3 +90,94 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// Find or create the shared-memory segment with key
+// of at least size bytes; return its id.
+int
+sys_shmget(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmget(key, size);
+}
+
+// Map a shared-memory segment; return its address.
+int
+sys_shmat(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(id);
+}
+
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return shmdt((uint)addr);
+}
+
+static void
+tsc2tv(uint64 c, struct timeval *tv)
+{
+  uint64 us;
+
+  us = tsc2us(c);
+  tv->sec = div64(us, 1000000);
+  tv->usec = us - (uint64)tv->sec*1000000;
+}
+
+// Report the resources used by this process or
+// by the children it has waited for.
+int
+sys_getrusage(void)
+{
+  struct pacct *a;
+  struct rusage *ru;
+  int who;
+
+  if(argint(0, &who) < 0 || argptrw(1, (void*)&ru, sizeof(*ru)) < 0)
+    return -1;
+  if(who == RUSAGE_SELF)
+    a = &myproc()->acct;
+  else if(who == RUSAGE_CHILDREN)
+    a = &myproc()->cacct;
+  else
+    return -1;
+  tsc2tv(a->utime, &ru->utime);
+  tsc2tv(a->stime, &ru->stime);
+  ru->nvcsw = a->nvcsw;
+  ru->nivcsw = a->nivcsw;
+  ru->nfault = a->nfault;
+  ru->nstack = a->nstack;
+  ru->inblock = a->inblock;
+  ru->oublock = a->oublock;
+  return 0;
+}
+
+// Report times in clock ticks, and return
+// the ticks since boot.
+int
+sys_times(void)
+{
+  struct proc *curproc = myproc();
+  struct tms *t;
+
+  if(argptrw(0, (void*)&t, sizeof(*t)) < 0)
+    return -1;
+  if(tsctick){
+    t->utime = div64(curproc->acct.utime, tsctick);
+    t->stime = div64(curproc->acct.stime, tsctick);
+    t->cutime = div64(curproc->cacct.utime, tsctick);
+    t->cstime = div64(curproc->cacct.stime, tsctick);
+  } else
+    t->utime = t->stime = t->cutime = t->cstime = 0;
+  return sys_uptime();
+}
@@ -0,0 +1,186 @@
+// Shared program text.
+//
+// exec() maps the file-backed pages of a program's loadable
+// segments from a cache kept per inode, rather than reading a
+// private copy of them for every process.  The pages are mapped
+// read-only with PTE_COW, so that the first write to one gives the
+// writing process its own copy (see cowfault() in vm.c) and pages
+// that are never written, such as the text, stay shared by every
+// process running the program.  The pages are reference counted by
+// kalloc.c, like shared memory: the cache holds one reference and
+// every mapping another.
+//
+// A segment is cached under the device and inode number of its file
+// and its offset in the file.  Writing or truncating the file drops
+// the file's segments; processes already running keep their pages.
+// Both exec() and the writers hold the inode's lock, which keeps
+// a segment from changing while exec() fills or maps it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NTEXTPG ((MAXFILE*BSIZE + PGSIZE - 1) / PGSIZE)
+
+struct text {
+  uint dev;
+  uint inum;                   // 0 if this slot is free
+  uint off, filesz;            // the segment in the file
+  int busy;                    // exec() is using it
+  uint used;                   // when last used, for eviction
+  char *pages[NTEXTPG];        // 0 until read from the file
+};
+
+struct {
+  struct spinlock lock;
+  struct text text[NTEXT];
+  uint clock;
+} tcache;
+
+void
+textinit(void)
+{
+  initlock(&tcache.lock, "text");
+}
+
+// Free the pages of t and its slot.  Caller holds tcache.lock.
+static void
+textfree(struct text *t)
+{
+  int i;
+
+  for(i = 0; i < NTEXTPG; i++)
+    if(t->pages[i]){
+      kfree(t->pages[i]);
+      t->pages[i] = 0;
+    }
+  t->inum = 0;
+}
+
+// Find the segment of ip at off, or take a slot for it, the least
+// recently used one if all are full.  Returns 0 if all are busy.
+static struct text*
+textget(struct inode *ip, uint off, uint filesz)
+{
+  struct text *t, *victim;
+
+  acquire(&tcache.lock);
+  victim = 0;
+  for(t = tcache.text; t < &tcache.text[NTEXT]; t++){
+    if(t->inum == ip->inum && t->dev == ip->dev &&
+       t->off == off && t->filesz == filesz)
+      goto found;
+    if(t->busy)
+      continue;
+    if(victim == 0 || t->inum == 0 || (victim->inum && t->used < victim->used))
+      victim = t;
+  }
+  if((t = victim) == 0){
+    release(&tcache.lock);
+    return 0;
+  }
+  if(t->inum)
+    textfree(t);
+  t->dev = ip->dev;
+  t->inum = ip->inum;
+  t->off = off;
+  t->filesz = filesz;
+found:
+  t->busy++;
+  t->used = ++tcache.clock;
+  release(&tcache.lock);
+  return t;
+}
+
+static void
+textput(struct text *t)
+{
+  acquire(&tcache.lock);
+  t->busy--;
+  release(&tcache.lock);
+}
+
+// Map the filesz bytes of ip at off into pgdir at va, which must be
+// page-aligned, copy-on-write, with zeros after filesz to the end of
+// the last page.  Caller holds ip's lock, perhaps shared, so another
+// exec may be reading the same page.  Returns the end of the
+// mapped pages, 0 if the segment cannot be cached, or -1 on error.
+int
+textmap(pde_t *pgdir, uint va, struct inode *ip, uint off, uint filesz)
+{
+  struct text *t;
+  uint i, n;
+  char *mem;
+
+  if(filesz == 0 || filesz > NTEXTPG*PGSIZE)
+    return 0;
+  if((t = textget(ip, off, filesz)) == 0)
+    return 0;
+  for(i = 0; i < filesz; i += PGSIZE){
+    if((mem = t->pages[i/PGSIZE]) == 0){
+      if((mem = kalloc()) == 0)
+        goto bad;
+      n = filesz - i < PGSIZE ? filesz - i : PGSIZE;
+      if(readi(ip, mem, off + i, n) != n){
+        kfree(mem);
+        goto bad;
+      }
+      memset(mem + n, 0, PGSIZE - n);
+      acquire(&tcache.lock);
+      if(t->pages[i/PGSIZE] == 0)
+        t->pages[i/PGSIZE] = mem;
+      else {
+        kfree(mem);  // the other exec read it first
+        mem = t->pages[i/PGSIZE];
+      }
+      release(&tcache.lock);
+    }
+    if(shareuvm(pgdir, va + i, V2P(mem), PTE_U|PTE_COW) < 0)
+      goto bad;
+  }
+  textput(t);
+  return va + i;
+
+bad:
+  textput(t);
+  return -1;
+}
+
+// The contents of ip are changing: drop its cached segments.
+// Caller holds ip's lock.
+void
+textinval(struct inode *ip)
+{
+  struct text *t;
+
+  acquire(&tcache.lock);
+  for(t = tcache.text; t < &tcache.text[NTEXT]; t++)
+    if(t->inum == ip->inum && t->dev == ip->dev && !t->busy)
+      textfree(t);
+  release(&tcache.lock);
+}
+
+// Free every segment not in use, when memory runs out.
+// Returns the number of segments freed.
+int
+textreclaim(void)
+{
+  struct text *t;
+  int n;
+
+  n = 0;
+  acquire(&tcache.lock);
+  for(t = tcache.text; t < &tcache.text[NTEXT]; t++)
+    if(t->inum && !t->busy){
+      textfree(t);
+      n++;
+    }
+  release(&tcache.lock);
+  return n;
+}
@@ -0,0 +1,196 @@
+// Show what the processes and CPUs are doing.
+// Every interval ticks, top reads /proc/cpus and /proc/procs and
+// prints how busy each CPU was and each process's share of a CPU
+// over the interval, with the counters /proc keeps for it.
+// Usage: top [interval [count]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define MAXP 64    // NPROC
+#define MAXC 8     // NCPU
+
+char buf[8192];
+
+struct {
+  int pid;
+  uint time;       // utime + stime, in ms
+} prev[MAXP], cur[MAXP];
+int nprev, ncur;
+uint prevbusy[MAXC], previdle[MAXC];
+
+// Read all of path into buf, nul-terminated.
+int
+readall(char *path)
+{
+  int fd, n, tot;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf(2, "top: cannot open %s\n", path);
+    exit();
+  }
+  for(tot = 0; tot < sizeof(buf) - 1; tot += n)
+    if((n = read(fd, buf + tot, sizeof(buf) - 1 - tot)) <= 0)
+      break;
+  close(fd);
+  buf[tot] = 0;
+  return tot;
+}
+
+// Split off the next word of the line at *p.
+char*
+word(char **p)
+{
+  char *s;
+
+  while(**p == ' ')
+    (*p)++;
+  s = *p;
+  while(**p && **p != ' ' && **p != '\n')
+    (*p)++;
+  if(**p == ' ')
+    *(*p)++ = 0;
+  return s;
+}
+
+// Print s right-justified in width columns, after a space.
+void
+col(char *s, int width)
+{
+  for(width -= strlen(s); width > 0; width--)
+    printf(1, " ");
+  printf(1, " %s", s);
+}
+
+void
+coln(uint x, int width)
+{
+  char num[11];
+  int i;
+
+  i = sizeof(num) - 1;
+  num[i] = 0;
+  do{
+    num[--i] = '0' + x % 10;
+  }while((x /= 10) != 0);
+  col(num + i, width);
+}
+
+// Split off the line at *p.
+char*
+nextline(char **p)
+{
+  char *s;
+
+  s = *p;
+  while(**p && **p != '\n')
+    (*p)++;
+  if(**p)
+    *(*p)++ = 0;
+  return s;
+}
+
+void
+cpus(int print)
+{
+  char *p, *l;
+  uint busy, idle, db, di;
+  int c;
+
+  readall("/proc/cpus");
+  p = buf;
+  nextline(&p);  // header
+  while(*p){
+    l = nextline(&p);
+    c = atoi(word(&l));
+    word(&l);
+    word(&l);
+    idle = atoi(word(&l));
+    busy = atoi(word(&l));
+    if(c < 0 || c >= MAXC)
+      continue;
+    db = busy - prevbusy[c];
+    di = idle - previdle[c];
+    if(print)
+      printf(1, "cpu%d: %d%% busy\n", c, db + di ? 100*db/(db + di) : 0);
+    prevbusy[c] = busy;
+    previdle[c] = idle;
+  }
+}
+
+void
+procs(int print, uint interval)
+{
+  char *p, *l, *pid, *state, *name;
+  char *rss, *fds, *nsys, *flt, *vcsw, *ivcsw;
+  uint t, d;
+  int i;
+
+  readall("/proc/procs");
+  p = buf;
+  nextline(&p);
+  if(print)
+    printf(1, "  pid  state %%cpu  rss fds syscalls faults    vcsw   ivcsw name\n");
+  ncur = 0;
+  while(*p && ncur < MAXP){
+    l = nextline(&p);
+    if(*l == 0)
+      continue;
+    pid = word(&l);
+    word(&l);
+    state = word(&l);
+    t = atoi(word(&l));
+    t += atoi(word(&l));
+    vcsw = word(&l);
+    ivcsw = word(&l);
+    flt = word(&l);
+    rss = word(&l);
+    fds = word(&l);
+    nsys = word(&l);
+    name = word(&l);
+    cur[ncur].pid = atoi(pid);
+    cur[ncur].time = t;
+    // A new process used all its time in the interval.
+    d = t;
+    for(i = 0; i < nprev; i++)
+      if(prev[i].pid == cur[ncur].pid)
+        d = t - prev[i].time;
+    ncur++;
+    if(print){
+      col(pid, 4);
+      col(state, 6);
+      coln(10*d/interval, 4);  // d in ms, 10 ms a tick
+      col(rss, 4);
+      col(fds, 3);
+      col(nsys, 8);
+      col(flt, 6);
+      col(vcsw, 7);
+      col(ivcsw, 7);
+      printf(1, " %s\n", name);
+    }
+  }
+  memmove(prev, cur, sizeof(cur));
+  nprev = ncur;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int interval, count, i;
+
+  interval = argc > 1 ? atoi(argv[1]) : 100;
+  count = argc > 2 ? atoi(argv[2]) : 5;
+  if(interval <= 0)
+    interval = 100;
+  cpus(0);
+  procs(0, 1);
+  for(i = 0; i < count; i++){
+    sleep(interval);
+    printf(1, "\n");
+    cpus(1);
+    procs(1, interval);
+  }
+  exit();
+}
@@ -13,6 +13,8 @@ struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+uint tsctick;           // TSC cycles per tick, measured by CPU 0
+static uint64 tsclast;  // TSC at the last measurement
 
 void
 tvinit(void)
@@ -32,28 +34,80 @@ idtinit(void)
   lidt(idt, sizeof(idt));
 }
 
+// Convert TSC cycles to microseconds.
+uint64
+tsc2us(uint64 c)
+{
+  uint64 t;
+
+  if(tsctick == 0)
+    return 0;
+  t = div64(c, tsctick);
+  return t*10000 + div64((c - t*tsctick) * 10000, tsctick);
+}
+
+// Charge the time since p->tsc to p's user or system time.
+// The scheduler starts the count when it runs p, and sched()
+// charges the rest when p gives up the CPU.
+static void
+charge(struct proc *p, int user)
+{
+  uint64 now;
+
+  now = rdtsc();
+  if(user)
+    p->acct.utime += now - p->tsc;
+  else
+    p->acct.stime += now - p->tsc;
+  p->tsc = now;
+}
+
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  uint64 now;
+
+  if((tf->cs&3) == DPL_USER)
+    charge(myproc(), 1);
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
     myproc()->tf = tf;
+    myproc()->insyscall = 1;
     syscall();
+    myproc()->insyscall = 0;
+    myproc()->bufend = 0;
     if(myproc()->killed)
       exit();
+    charge(myproc(), 0);
     return;
   }
 
+  if(tf->trapno >= T_IRQ0)
+    mycpu()->nintr++;
+
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
+    if(myproc() == 0)
+      mycpu()->idle++;
+    else
+      mycpu()->busy++;
     if(cpuid() == 0){
       acquire(&tickslock);
       ticks++;
+      if(ticks % 10 == 0){
+        now = rdtsc();
+        if(tsclast)
+          tsctick = div64(now - tsclast, 10);
+        tsclast = now;
+      }
       wakeup(&ticks);
       release(&tickslock);
+      pollwakeup(&tickpollq);
     }
+    klogdrain();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -78,8 +132,23 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // A write to a copy-on-write page, a touch of the stack below
+    // what has been used, or of a page that is swapped out, by the
+    // process or by the kernel on its behalf: CR0_WP makes the
+    // kernel fault on writes too.
+    if(myproc() && (cowfault(myproc()->pgdir, rcr2()) == 0 ||
+                    swapin(myproc()->pgdir, rcr2()) == 0 ||
+                    growstack(myproc(), rcr2()) == 0)){
+      myproc()->acct.nfault++;
+      break;
+    }
+    // fall through
+
   //PAGEBREAK: 13
   default:
+    if(tf->trapno == T_PGFLT && myproc())
+      myproc()->acct.nfault++;
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
@@ -109,4 +178,7 @@ trap(struct trapframe *tf)
   // Check if the process has been killed since we yielded
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
+
+  if((tf->cs&3) == DPL_USER)
+    charge(myproc(), 0);
 }
@@ -1,4 +1,9 @@
 // Intel 8250 serial port (UART).
+//
+// Output goes through a transmit ring that the transmitter-empty
+// interrupt drains, so writers do not wait on the line.  A writer
+// that finds the ring full sleeps (uartwrite) or, if it cannot
+// sleep, sends one byte by polling to make room (uartputc).
 
 #include "types.h"
 #include "defs.h"
@@ -13,16 +18,27 @@
 #include "x86.h"
 
 #define COM1    0x3f8
+#define FIFOSZ  16         // 16550 transmit FIFO
+#define TXBUF   1024
 
 static int uart;    // is there a uart?
 
+static struct {
+  struct spinlock lock;
+  char buf[TXBUF];
+  uint r;  // Next byte to send
+  uint w;  // Next free slot
+} tx;
+
 void
 uartinit(void)
 {
   char *p;
 
-  // Turn off the FIFO
-  outb(COM1+2, 0);
+  initlock(&tx.lock, "uart");
+
+  // Turn on and clear the FIFOs; receive interrupt at 1 byte.
+  outb(COM1+2, 0x07);
 
   // 9600 baud, 8 data bits, 1 stop bit, parity off.
   outb(COM1+3, 0x80);    // Unlock divisor
@@ -30,7 +46,7 @@ uartinit(void)
   outb(COM1+1, 0);
   outb(COM1+3, 0x03);    // Lock divisor, 8 data bits.
   outb(COM1+4, 0);
-  outb(COM1+1, 0x01);    // Enable receive interrupts.
+  outb(COM1+1, 0x03);    // Enable receive and transmit interrupts.
 
   // If status is 0xFF, no serial port.
   if(inb(COM1+5) == 0xFF)
@@ -48,15 +64,80 @@ uartinit(void)
     uartputc(*p);
 }
 
+// Wait until the transmitter can take a byte.
+static void
+txwait(void)
+{
+  int i;
+
+  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
+    microdelay(10);
+}
+
+// Move bytes from the ring to the transmit FIFO if it is empty.
+// Caller must hold tx.lock.
+static void
+uartstart(void)
+{
+  int i;
+
+  if(tx.r == tx.w || !(inb(COM1+5) & 0x20))
+    return;
+  for(i = 0; i < FIFOSZ && tx.r != tx.w; i++)
+    outb(COM1+0, tx.buf[tx.r++ % TXBUF]);
+  wakeup(&tx.r);
+}
+
+// Queue c for output without sleeping; used by cprintf and
+// input echo, which may hold locks or run in interrupts.
 void
 uartputc(int c)
+{
+  if(!uart)
+    return;
+  acquire(&tx.lock);
+  if(tx.w == tx.r + TXBUF){
+    txwait();
+    outb(COM1+0, tx.buf[tx.r++ % TXBUF]);
+  }
+  tx.buf[tx.w++ % TXBUF] = c;
+  uartstart();
+  release(&tx.lock);
+}
+
+// Queue n bytes for output, sleeping while the ring is full.
+void
+uartwrite(char *buf, int n)
 {
   int i;
 
   if(!uart)
     return;
-  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
-    microdelay(10);
+  acquire(&tx.lock);
+  for(i = 0; i < n; i++){
+    while(tx.w == tx.r + TXBUF){
+      uartstart();
+      sleep(&tx.r, &tx.lock);
+    }
+    tx.buf[tx.w++ % TXBUF] = buf[i];
+  }
+  uartstart();
+  release(&tx.lock);
+}
+
+// Send c by polling, after whatever is queued, without
+// taking tx.lock.  For panic(), when other CPUs are frozen
+// and may hold the lock.
+void
+uartputc_sync(int c)
+{
+  if(!uart)
+    return;
+  while(tx.r != tx.w){
+    txwait();
+    outb(COM1+0, tx.buf[tx.r++ % TXBUF]);
+  }
+  txwait();
   outb(COM1+0, c);
 }
 
@@ -73,5 +154,13 @@ uartgetc(void)
 void
 uartintr(void)
 {
-  consoleintr(uartgetc);
+  // Loop until the UART has nothing pending, since the
+  // interrupt is edge-triggered.  Reading the interrupt
+  // identification acknowledges a transmitter-empty interrupt.
+  while(uart && (inb(COM1+2) & 0x01) == 0){
+    consoleintr(uartgetc);
+    acquire(&tx.lock);
+    uartstart();
+    release(&tx.lock);
+  }
 }
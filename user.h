@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct pollfd;
+struct mcall;
+struct rusage;
+struct tms;
+struct spawnact;
 
 // system calls
 int fork(void);
@@ -23,6 +28,21 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int shmget(int, int);
+void* shmat(int);
+int shmdt(void*);
+int poll(struct pollfd*, int, int);
+int pipe2(int*, int);
+void* aiosetup(int);
+int aioenter(int);
+int multicall(struct mcall*, int, int);
+int pread(int, void*, int, uint);
+int pwrite(int, const void*, int, uint);
+int fsync(int);
+int getrusage(int, struct rusage*);
+int times(struct tms*);
+int spawn(char*, char**, struct spawnact*, int);
+int sync(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,10 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "poll.h"
+#include "multicall.h"
+#include "rusage.h"
+#include "spawn.h"
 
 char buf[8192];
 char name[3];
@@ -1695,6 +1699,266 @@ fsfull()
   printf(1, "fsfull test finished\n");
 }
 
+// shared-memory segments are shared with a forked child
+// and can be found again by key, and one that is never
+// attached goes away when its creator exits.
+void
+shmtest(void)
+{
+  int id, pid;
+  char *a;
+
+  printf(stdout, "shm test\n");
+  id = shmget(0x5e9, 2*4096);
+  if(id < 0 || (a = shmat(id)) == (char*)-1){
+    printf(stdout, "shmget/shmat failed\n");
+    exit();
+  }
+  if(shmget(0x5e9, 4096) != id){
+    printf(stdout, "shmget did not find segment by key\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    a[0] = 'x';
+    a[4096+1] = 'y';
+    shmget(0x5ea, 4096);
+    exit();
+  }
+  wait();
+  if(a[0] != 'x' || a[4096+1] != 'y'){
+    printf(stdout, "shm write by child not visible\n");
+    exit();
+  }
+  if(shmget(0x5ea, 2*4096) < 0){
+    printf(stdout, "unattached shm segment leaked\n");
+    exit();
+  }
+  if(shmdt(a) < 0 || sbrk(0) != a){
+    printf(stdout, "shmdt failed\n");
+    exit();
+  }
+  printf(stdout, "shm test ok\n");
+}
+
+// poll() and O_NONBLOCK on a pipe.
+void
+polltest(void)
+{
+  struct pollfd pfd[2];
+  int fds[2];
+
+  printf(stdout, "poll test\n");
+  if(pipe2(fds, O_NONBLOCK) < 0){
+    printf(stdout, "pipe2 failed\n");
+    exit();
+  }
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLOUT;
+  if(read(fds[0], buf, 1) != -1 || poll(pfd, 1, 2) != 0 ||
+     poll(pfd, 2, -1) != 1 || pfd[1].revents != POLLOUT){
+    printf(stdout, "poll on empty pipe wrong\n");
+    exit();
+  }
+  if(fork() == 0){
+    sleep(2);
+    write(fds[1], "x", 1);
+    exit();
+  }
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLIN ||
+     read(fds[0], buf, sizeof(buf)) != 1){
+    printf(stdout, "poll did not see write\n");
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  printf(stdout, "poll test ok\n");
+}
+
+// multicall() runs calls in order and can stop at an error.
+void
+multicalltest(void)
+{
+  struct mcall mc[3];
+
+  printf(stdout, "multicall test\n");
+  mc[0].num = SYS_getpid;
+  mc[1].num = SYS_close;
+  mc[1].args[0] = -1;
+  mc[2].num = SYS_fork;
+  if(multicall(mc, 3, 0) != 3 || mc[0].ret != getpid() ||
+     mc[1].ret != -1 || mc[2].ret != -1 ||
+     multicall(mc, 3, MC_STOPERR) != 2){
+    printf(stdout, "multicall wrong\n");
+    exit();
+  }
+  printf(stdout, "multicall test ok\n");
+}
+
+void
+preadtest(void)
+{
+  char b[4];
+  int fd;
+
+  printf(stdout, "pread test\n");
+  fd = open("preadf", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abcdef", 6) != 6 || pwrite(fd, "XY", 2, 1) != 2 ||
+     pread(fd, b, 4, 0) != 4 || b[1] != 'X' || b[3] != 'd' ||
+     write(fd, "g", 1) != 1 || pread(fd, b, 4, 5) != 2 || b[1] != 'g' ||
+     fsync(fd) != 0 || sync() != 0 || fsync(-1) != -1){
+    printf(stdout, "pread/pwrite/sync wrong\n");
+    exit();
+  }
+  close(fd);
+  unlink("preadf");
+  printf(stdout, "pread test ok\n");
+}
+
+// A child's CPU time shows up in RUSAGE_CHILDREN once waited for.
+void
+rusagetest(void)
+{
+  struct rusage r;
+  struct tms t;
+  uint t0;
+
+  printf(stdout, "rusage test\n");
+  if(fork() == 0){
+    t0 = uptime();
+    while(uptime() < t0 + 3)
+      ;
+    exit();
+  }
+  wait();
+  if(getrusage(RUSAGE_CHILDREN, &r) < 0 || r.utime.usec + r.utime.sec == 0 ||
+     times(&t) <= 0 || getrusage(2, &r) != -1){
+    printf(stdout, "rusage wrong\n");
+    exit();
+  }
+  printf(stdout, "rusage test ok\n");
+}
+
+// spawn() with its stdout redirected to a file.
+void
+spawntest(void)
+{
+  char *argv[] = { "echo", "spawned", 0 };
+  struct spawnact act;
+  char b[16];
+  int fd, n;
+
+  printf(stdout, "spawn test\n");
+  act.op = SPAWN_OPEN;
+  act.newfd = 1;
+  act.path = "spawnout";
+  act.mode = O_CREATE|O_WRONLY;
+  if(spawn("echo", argv, &act, 1) < 0 || wait() < 0){
+    printf(stdout, "spawn failed\n");
+    exit();
+  }
+  fd = open("spawnout", O_RDONLY);
+  n = read(fd, b, sizeof(b));
+  close(fd);
+  unlink("spawnout");
+  if(n != 8 || b[0] != 's' || b[7] != '\n'){
+    printf(stdout, "spawn output wrong\n");
+    exit();
+  }
+  printf(stdout, "spawn test ok\n");
+}
+
+// Program data starts out shared copy-on-write with the text
+// cache, so the writes to it so far took page faults.
+void
+cowtest(void)
+{
+  struct rusage r;
+
+  printf(stdout, "cow test\n");
+  if(getrusage(RUSAGE_SELF, &r) < 0 || r.nfault == 0){
+    printf(stdout, "no copy-on-write faults\n");
+    exit();
+  }
+  printf(stdout, "cow test ok\n");
+}
+
+// A stack frame bigger than the stack page makes the stack grow.
+void
+stacktest(void)
+{
+  volatile char b[3*4096];
+  struct rusage r;
+
+  printf(stdout, "stack test\n");
+  b[0] = 1;
+  if(b[0] != 1 || getrusage(RUSAGE_SELF, &r) < 0 || r.nstack == 0){
+    printf(stdout, "stack did not grow\n");
+    exit();
+  }
+  printf(stdout, "stack test ok\n");
+}
+
+// New memory reads as zeros without a fault, and gets a page
+// of its own when written.
+void
+zerotest(void)
+{
+  struct rusage r0, r1;
+  char *a;
+  int i, s;
+
+  printf(stdout, "zero page test\n");
+  a = sbrk(64*4096);
+  getrusage(RUSAGE_SELF, &r0);
+  for(i = s = 0; i < 64*4096; i += 4096)
+    s += a[i];
+  a[4096] = 1;
+  getrusage(RUSAGE_SELF, &r1);
+  if(s != 0 || a[0] != 0 || a[4096] != 1 || r1.nfault != r0.nfault + 1){
+    printf(stdout, "zero page test failed\n");
+    exit();
+  }
+  sbrk(-64*4096);
+  printf(stdout, "zero page test ok\n");
+}
+
+// /proc/procs lists this process.
+void
+proctest(void)
+{
+  static char b[8192];
+  int fd, i, n, found;
+
+  printf(stdout, "proc test\n");
+  fd = open("/proc/procs", O_RDONLY);
+  n = fd < 0 ? -1 : read(fd, b, sizeof(b) - 1);
+  close(fd);
+  if(n <= 0){
+    printf(stdout, "cannot read /proc/procs\n");
+    exit();
+  }
+  found = 0;
+  for(i = 10; i < n; i++)
+    if(b[i] == '\n'){
+      b[i] = 0;
+      if(strcmp(b + i - 10, " usertests") == 0)
+        found = 1;
+    }
+  if(!found){
+    printf(stdout, "/proc/procs wrong\n");
+    exit();
+  }
+  printf(stdout, "proc test ok\n");
+}
+
 void
 uio()
 {
@@ -1780,6 +2044,16 @@ main(int argc, char *argv[])
   iputtest();
 
   mem();
+  shmtest();
+  polltest();
+  multicalltest();
+  preadtest();
+  proctest();
+  rusagetest();
+  spawntest();
+  cowtest();
+  stacktest();
+  zerotest();
   pipe1();
   preempt();
   exitwait();
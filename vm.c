@@ -6,10 +6,35 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+// Per-CPU caches of kernel stacks, and of page directories whose
+// user part is empty but whose kernel part is still set up, so
+// that fork(), exec(), exit() and wait() seldom go to the page
+// allocator or rebuild the kernel mappings.  kalloc() empties the
+// caches with vmreclaim() when it runs out of memory.
+struct vmcache {
+  struct spinlock lock;
+  char *kstack[NVMCACHE];
+  int nkstack;
+  pde_t *pgdir[NVMCACHE];
+  int npgdir;
+} vmcache[NCPU];
+
+static struct vmcache*
+mycache(void)
+{
+  struct vmcache *c;
+
+  pushcli();
+  c = &vmcache[cpuid()];
+  popcli();
+  return c;
+}
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -32,7 +57,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -42,10 +67,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -114,36 +138,127 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
-pde_t*
-setupkvm(void)
+static void freepgdir(pde_t*);
+
+// Make a page table with just the kernel part.
+static pde_t*
+newkvm(void)
 {
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
     if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
                 (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
+      freepgdir(pgdir);
       return 0;
     }
   return pgdir;
 }
 
+// Set up kernel part of a page table.
+pde_t*
+setupkvm(void)
+{
+  pde_t *pgdir;
+  struct vmcache *c;
+
+  c = mycache();
+  pgdir = 0;
+  acquire(&c->lock);
+  if(c->npgdir > 0)
+    pgdir = c->pgdir[--c->npgdir];
+  release(&c->lock);
+  if(pgdir == 0)
+    pgdir = newkvm();
+  return pgdir;
+}
+
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes.  This runs before mpinit(), so
+// it cannot use the caches yet.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&vmcache[i].lock, "vmcache");
+  kpgdir = newkvm();
   switchkvm();
 }
 
+// Allocate a kernel stack of KSTACKSIZE bytes.
+char*
+kstackalloc(void)
+{
+  struct vmcache *c;
+  char *s;
+
+  c = mycache();
+  s = 0;
+  acquire(&c->lock);
+  if(c->nkstack > 0)
+    s = c->kstack[--c->nkstack];
+  release(&c->lock);
+  if(s == 0)
+    s = kalloc();
+  return s;
+}
+
+void
+kstackfree(char *s)
+{
+  struct vmcache *c;
+
+  c = mycache();
+  acquire(&c->lock);
+  if(c->nkstack < NVMCACHE){
+    c->kstack[c->nkstack++] = s;
+    s = 0;
+  }
+  release(&c->lock);
+  if(s)
+    kfree(s);
+}
+
+// Free everything in the caches.  Returns the number
+// of stacks and page directories freed.
+int
+vmreclaim(void)
+{
+  struct vmcache *c;
+  pde_t *pgdir;
+  char *s;
+  int n;
+
+  n = 0;
+  for(c = vmcache; c < &vmcache[NCPU]; c++){
+    for(;;){
+      s = 0;
+      pgdir = 0;
+      acquire(&c->lock);
+      if(c->nkstack > 0)
+        s = c->kstack[--c->nkstack];
+      else if(c->npgdir > 0)
+        pgdir = c->pgdir[--c->npgdir];
+      release(&c->lock);
+      if(s)
+        kfree(s);
+      else if(pgdir)
+        freepgdir(pgdir);
+      else
+        break;
+      n++;
+    }
+  }
+  return n;
+}
+
 // Switch h/w page table register to the kernel-only page table,
 // for when no process is running.
 void
@@ -186,8 +301,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
@@ -205,6 +319,8 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
       panic("loaduvm: address should exist");
+    if((*pte & PTE_COW) && cowfault(pgdir, (uint)addr+i) < 0)
+      return -1;
     pa = PTE_ADDR(*pte);
     if(sz - i < PGSIZE)
       n = sz - i;
@@ -216,12 +332,13 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   return 0;
 }
 
-// Allocate page tables and physical memory to grow process from oldsz to
-// newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Allocate page tables to grow process from oldsz to newsz, which
+// need not be page aligned, and map the new pages copy-on-write to
+// the zero page; the first write to each gives it its own memory
+// (see cowfault()).  Returns new size or 0 on error.
 int
 allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 {
-  char *mem;
   uint a;
 
   if(newsz >= KERNBASE)
@@ -230,20 +347,15 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
+  if(a < newsz && kcommit((PGROUNDUP(newsz) - a) / PGSIZE) < 0)
+    return 0;
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
-    if(mem == 0){
+    if(mappages(pgdir, (char*)a, PGSIZE, V2P(zeropage), PTE_U|PTE_COW) < 0){
       cprintf("allocuvm out of memory\n");
+      kuncommit((PGROUNDUP(newsz) - a) / PGSIZE);
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
-    if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
-      cprintf("allocuvm out of memory (2)\n");
-      deallocuvm(pgdir, newsz, oldsz);
-      kfree(mem);
-      return 0;
-    }
   }
   return newsz;
 }
@@ -271,23 +383,54 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       if(pa == 0)
         panic("kfree");
       char *v = P2V(pa);
+      if(v == zeropage)
+        kuncommit(1);
       kfree(v);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
+      *pte = 0;
     }
   }
   return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  The page directory, with its kernel
+// part, goes to this CPU's cache if there is room.
 void
 freevm(pde_t *pgdir)
 {
+  struct vmcache *c;
   uint i;
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if(pgdir[i] & PTE_P){
+      kfree(P2V(PTE_ADDR(pgdir[i])));
+      pgdir[i] = 0;
+    }
+  }
+
+  c = mycache();
+  acquire(&c->lock);
+  if(c->npgdir < NVMCACHE){
+    c->pgdir[c->npgdir++] = pgdir;
+    pgdir = 0;
+  }
+  release(&c->lock);
+  if(pgdir)
+    freepgdir(pgdir);
+}
+
+// Free a page directory and its page tables.
+static void
+freepgdir(pde_t *pgdir)
+{
+  uint i;
+
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -297,6 +440,20 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+// Map the already-allocated physical page pa at user address va
+// in pgdir, taking a reference to the page. Used to share one page
+// between several page tables.  Returns 0 on success, -1 on error.
+int
+shareuvm(pde_t *pgdir, uint va, uint pa, int perm)
+{
+  if(va >= KERNBASE || va % PGSIZE != 0)
+    return -1;
+  if(mappages(pgdir, (char*)va, PGSIZE, pa, perm) < 0)
+    return -1;
+  kincref(P2V(pa));
+  return 0;
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -310,6 +467,30 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
+// Count the pages mapped below sz, other than the zero page.
+int
+uvmresident(pde_t *pgdir, uint sz)
+{
+  pde_t *pde;
+  pte_t *pgtab;
+  uint a;
+  int n;
+
+  n = 0;
+  for(a = 0; a < sz && a < KERNBASE; a += PGSIZE){
+    pde = &pgdir[PDX(a)];
+    if(!(*pde & PTE_P)){
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+    if((pgtab[PTX(a)] & PTE_P) &&
+       PTE_ADDR(pgtab[PTX(a)]) != V2P(zeropage))
+      n++;
+  }
+  return n;
+}
+
 // Given a parent process's page table, create a copy
 // of it for a child.
 pde_t*
@@ -323,14 +504,34 @@ copyuvm(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || *pte == 0)
+      continue;  // not yet used by a growing stack
+    // A page that is not present is swapped out; bring it back.
+    if(!(*pte & PTE_P) && swapin(pgdir, i) < 0)
+      goto bad;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & (PTE_SHARED|PTE_COW)){
+      // Shared memory, or a page still shared copy-on-write:
+      // map the same page in the child.
+      if(pa == V2P(zeropage) && kcommit(1) < 0)
+        goto bad;
+      if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0){
+        if(pa == V2P(zeropage))
+          kuncommit(1);
+        goto bad;
+      }
+      kincref(P2V(pa));
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto bad;
+    // kalloc() may have paged the page out; if so, bring it back.
+    if(!(*pte & PTE_P) && swapin(pgdir, i) < 0){
+      kfree(mem);
+      goto bad;
+    }
+    pa = PTE_ADDR(*pte);
     memmove(mem, (char*)P2V(pa), PGSIZE);
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
@@ -344,6 +545,86 @@ bad:
   return 0;
 }
 
+// Give the process its own copy of the copy-on-write page at va,
+// whose write to it faulted, and make the page writable.  The
+// last process to map a page gets to keep it; a mapping of the
+// zero page always gets a new zeroed page.  Returns -1 if va
+// is not a copy-on-write page or memory ran out.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint pa, flags;
+  char *mem;
+
+  if(va >= KERNBASE || (pte = walkpgdir(pgdir, (char*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_COW)) != (PTE_P|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+  if(pa == V2P(zeropage)){
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+    kuncommit(1);
+    pa = V2P(mem);
+  } else if(kref(P2V(pa)) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    kfree(P2V(pa));
+    pa = V2P(mem);
+  }
+  *pte = pa | flags;
+  invlpg((char*)va);  // in case pgdir is the current page table
+  return 0;
+}
+
+// Add the page at va to p's stack, after a fault at it.
+// The stack may grow down to p->ustack; the page below
+// that is a guard.  Returns -1 if va is not in the
+// unused part of the stack or memory ran out.
+int
+growstack(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if(va < p->ustack || va >= p->ustack + USTACKSIZE || va >= p->sz)
+    return -1;
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) != 0 && *pte)
+    return -1;
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  p->acct.nstack++;
+  return 0;
+}
+
+// Do ahead of time what a fault on the page at va in p's memory
+// would: make it present, and if write is set, private and
+// writable.  Code holding a spinlock cannot take such a fault,
+// since kalloc() may not swap with interrupts off.  Returns -1
+// if va is not in p's memory or memory ran out.
+int
+uvmtouch(struct proc *p, uint va, int write)
+{
+  pte_t *pte;
+
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0 || *pte == 0)
+    return growstack(p, va);
+  if(!(*pte & PTE_P) && swapin(p->pgdir, va) < 0)
+    return -1;
+  if(write && (*pte & PTE_COW))
+    return cowfault(p->pgdir, va);
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -366,11 +647,17 @@ int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
+  pte_t *pte;
   uint n, va0;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    // A page still copy-on-write after cowfault() is shared,
+    // maybe the zero page, and must not be written.
+    if(cowfault(pgdir, va0) < 0 &&
+       (pte = walkpgdir(pgdir, (char*)va0, 0)) != 0 && (*pte & PTE_COW))
+      return -1;
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
@@ -130,6 +130,30 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Read the time-stamp counter.  Usable from user code too.
+static inline uint64
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
+}
+
+// a / b, without the 64-bit division helpers of libgcc,
+// which neither the kernel nor user programs link with.
+static inline uint64
+div64(uint64 a, uint b)
+{
+  uint hi, lo, r;
+
+  hi = a >> 32;
+  lo = a;
+  r = hi % b;
+  asm("divl %4" : "=a" (lo), "=d" (r) : "a" (lo), "d" (r), "rm" (b));
+  return (uint64)(hi / b) << 32 | lo;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +168,20 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+// Hint to the CPU that this is a spin loop.  Also a compiler
+// barrier, so the loop reads memory again.
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().